@@ -23,20 +23,156 @@ static inline void *do_alloc_object(struct alloc_state *s, size_t size)
     return ret;
 }
 
-static struct alloc_state node_state;
-void *alloc_node(void)
+// nodes differ in size, see new_node() in ast.c
+void *alloc_node(size_t size)
 {
-    return do_alloc_object(&node_state, sizeof(node_t));
+    return ralloc(REGION_TU, size);
 }
 
-static struct alloc_state token_state;
+static THREAD_LOCAL struct alloc_state token_state;
 void *alloc_token(void)
 {
     return do_alloc_object(&token_state, sizeof(struct token));
 }
 
-static struct alloc_state macro_state;
+static THREAD_LOCAL struct alloc_state macro_state;
 void *alloc_macro(void)
 {
     return do_alloc_object(&macro_state, sizeof(struct macro));
 }
+
+/* Regions
+ *
+ * A region hands out zeroed memory from large chunks and
+ * releases it all at once. Memory is asked from one of the
+ * named regions:
+ *
+ *   REGION_TU       lives as long as the translation unit
+ *   REGION_FUNC     the region bound to the function being
+ *                   lowered or emitted, falls back to the
+ *                   translation unit if none is bound
+ *   REGION_SCRATCH  released by its user as soon as the
+ *                   value is consumed
+ */
+#define REGION_CHUNK_SIZE   (64 * 1024)
+
+// strictest alignment of any object, union value holds a long double
+union align {
+    long long l;
+    long double d;
+    void *p;
+    void (*f) (void);
+};
+#define REGION_ALIGN        (sizeof(union align))
+
+struct chunk {
+    struct chunk *next;
+    char *avail;
+    char *limit;
+};
+
+struct region {
+    struct chunk *chunks;
+};
+
+static THREAD_LOCAL struct region *regions[REGIONS];
+
+#define CHUNK_HEAD          ROUNDUP(sizeof(struct chunk), REGION_ALIGN)
+
+// first aligned byte after the chunk header
+static char *chunk_base(struct chunk *c)
+{
+    return (char *)c + CHUNK_HEAD;
+}
+
+static struct chunk *new_chunk(size_t size)
+{
+    struct chunk *c = xmalloc(CHUNK_HEAD + size);
+    c->avail = chunk_base(c);
+    c->limit = c->avail + size;
+    c->next = NULL;
+    return c;
+}
+
+struct region *new_region(void)
+{
+    return zmalloc(sizeof(struct region));
+}
+
+static void free_chunks(struct region *r)
+{
+    struct chunk *c = r->chunks;
+    while (c) {
+        struct chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    r->chunks = NULL;
+}
+
+void free_region(struct region *r)
+{
+    if (!r)
+        return;
+    free_chunks(r);
+    free(r);
+}
+
+void *region_alloc(struct region *r, size_t size)
+{
+    size = ROUNDUP(size, REGION_ALIGN);
+    struct chunk *c = r->chunks;
+    if (c == NULL || size > c->limit - c->avail) {
+        if (size > REGION_CHUNK_SIZE / 4) {
+            // a chunk of its own, behind the current one
+            struct chunk *big = new_chunk(size);
+            if (c) {
+                big->next = c->next;
+                c->next = big;
+            } else {
+                r->chunks = big;
+            }
+            return memset(big->avail, 0, size);
+        }
+        c = new_chunk(REGION_CHUNK_SIZE);
+        c->next = r->chunks;
+        r->chunks = c;
+    }
+    void *p = c->avail;
+    c->avail += size;
+    return memset(p, 0, size);
+}
+
+// Bind 'r' to a named region, return the previous one.
+struct region *set_region(int name, struct region *r)
+{
+    struct region *old = regions[name];
+    regions[name] = r;
+    return old;
+}
+
+void *ralloc(int name, size_t size)
+{
+    if (name == REGION_FUNC && regions[REGION_FUNC] == NULL)
+        name = REGION_TU;
+    if (regions[name] == NULL)
+        regions[name] = new_region();
+    return region_alloc(regions[name], size);
+}
+
+/**
+ * Free everything in a named region, the region stays bound.
+ * The current chunk is kept for reuse.
+ */
+void release_region(int name)
+{
+    struct region *r = regions[name];
+    if (r == NULL || r->chunks == NULL)
+        return;
+    struct chunk *c = r->chunks;
+    r->chunks = c->next;
+    free_chunks(r);
+    c->next = NULL;
+    c->avail = chunk_base(c);
+    r->chunks = c;
+}
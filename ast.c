@@ -16,9 +16,28 @@ const char *nname(node_t * node)
     return node_names[AST_ID(node)];
 }
 
+// the size of the member of union ast_node used by 'id'
+static size_t node_size(int id)
+{
+    if (id > BEGIN_EXPR_ID && id < END_EXPR_ID)
+        return sizeof(struct ast_expr);
+    else if (id > BEGIN_STMT_ID && id < END_STMT_ID)
+        return sizeof(struct ast_stmt);
+    else if (id > BEGIN_DECL_ID && id < END_DECL_ID)
+        return sizeof(struct ast_decl);
+    else if (id == TYPE_NODE)
+        return sizeof(struct ast_type);
+    else if (id == FIELD_NODE)
+        return sizeof(struct ast_field);
+    else if (id == SYMBOL_NODE)
+        return sizeof(struct ast_symbol);
+    else
+        return sizeof(node_t);
+}
+
 static inline node_t *new_node(int id)
 {
-    node_t *n = alloc_node();
+    node_t *n = alloc_node(node_size(id));
     AST_ID(n) = id;
     return n;
 }
@@ -84,10 +103,20 @@ node_t *ast_inits(node_t * ty, struct source src)
     return expr;
 }
 
-node_t *ast_vinit(void)
+// a run of 'n' holes in an initializer list, holes carry no
+// data so all single holes share one node
+node_t *ast_vinit(int n)
 {
-    node_t *vinit = ast_expr(VINIT_EXPR, NULL, NULL, NULL);
-    return vinit;
+    static THREAD_LOCAL node_t *vinit;
+    node_t *expr;
+
+    if (n == 1 && vinit)
+        return vinit;
+    expr = ast_expr(VINIT_EXPR, NULL, NULL, NULL);
+    EXPR_VINIT_LEN(expr) = n;
+    if (n == 1)
+        vinit = expr;
+    return expr;
 }
 
 node_t *ast_stmt(int id, struct source src)
@@ -100,43 +129,81 @@ node_t *ast_stmt(int id, struct source src)
 
 node_t *copy_node(node_t * node)
 {
-    node_t *copy = alloc_node();
-    memcpy(copy, node, sizeof(node_t));
+    size_t size = node_size(AST_ID(node));
+    node_t *copy = alloc_node(size);
+    memcpy(copy, node, size);
+    // the backend data is not shared
+    if (isexpr(copy) && copy->expr.x) {
+        copy->expr.x = ralloc(REGION_TU, sizeof(struct expr_x));
+        *copy->expr.x = *node->expr.x;
+    }
     return copy;
 }
 
-const char *gen_label(void)
+/* Side tables
+ *
+ * The backend data of a node is allocated on its first
+ * access, zeroed like the rest of the node.
+ */
+struct sym_x *sym_x(node_t *sym)
 {
-    static size_t i;
-    return format(".L%llu", i++);
+    cc_assert(issymbol(sym));
+    if (!sym->symbol.x)
+        sym->symbol.x = ralloc(REGION_TU, sizeof(struct sym_x));
+    return sym->symbol.x;
 }
 
-const char *gen_tmpname(void)
+struct decl_x *decl_x(node_t *decl)
 {
-    static size_t i;
-    return format(".T%llu", i++);
+    cc_assert(isdecl(decl));
+    if (!decl->decl.x)
+        decl->decl.x = ralloc(REGION_TU, sizeof(struct decl_x));
+    return decl->decl.x;
+}
+
+struct expr_x *expr_x(node_t *expr)
+{
+    cc_assert(isexpr(expr));
+    if (!expr->expr.x)
+        expr->expr.x = ralloc(REGION_TU, sizeof(struct expr_x));
+    return expr->expr.x;
 }
 
-const char *gen_tmpname_r(void)
+struct stmt_x *stmt_x(node_t *stmt)
 {
-    static size_t i;
-    return format(".t%llu", i++);
+    cc_assert(isstmt(stmt));
+    if (!stmt->stmt.x)
+        stmt->stmt.x = ralloc(REGION_TU, sizeof(struct stmt_x));
+    return stmt->stmt.x;
+}
+
+// 0 is no label
+long gen_label(void)
+{
+    static THREAD_LOCAL long i;
+    return ++i;
+}
+
+const char *gen_tmpname(void)
+{
+    static THREAD_LOCAL size_t i;
+    return format(".T%llu", i++);
 }
 
 const char *gen_static_label(void)
 {
-    static size_t i;
+    static THREAD_LOCAL size_t i;
     return format(".S%llu", i++);
 }
 
 const char *gen_compound_label(void)
 {
-    static size_t i;
-    return format("__compound_literal.%llu", i++);
+    static THREAD_LOCAL size_t i;
+    return strs(format("__compound_literal.%llu", i++));
 }
 
 const char *gen_sliteral_label(void)
 {
-    static size_t i;
+    static THREAD_LOCAL size_t i;
     return format(".LC%llu", i++);
 }
@@ -40,6 +40,7 @@ struct ast_common {
 #define _TYPE_VARG(NODE)         ((NODE)->type.u.f.varg)
 #define _TYPE_TSYM(NODE)         ((NODE)->type.u.s.tsym)
 #define _TYPE_FIELDS(NODE)       ((NODE)->type.u.s.fields)
+#define _TYPE_INDEX(NODE)        ((NODE)->type.u.s.index)
 #define _TYPE_LIMITS_MAX(NODE)   ((NODE)->type.limits.max)
 #define _TYPE_LIMITS_MIN(NODE)   ((NODE)->type.limits.min)
 #define _TYPE_A_ASSIGN(NODE)     ((NODE)->type.u.a.assign)
@@ -68,6 +69,7 @@ struct ast_type {
             const char *tag;
             node_t *tsym;
             node_t **fields;
+            struct map *index;  // field slots by name, see find_field()
         } s;
         // array
         struct {
@@ -107,6 +109,7 @@ struct ast_field {
 #define SYM_PREDEFINE(NODE)   ((NODE)->symbol.predefine)
 #define SYM_VALUE(NODE)       ((NODE)->symbol.value)
 #define SYM_REFS(NODE)        ((NODE)->symbol.refs)
+#define SYM_GEN(NODE)         ((NODE)->symbol.gen)
 // convenience
 #define SYM_VALUE_U(NODE)     (VALUE_U(SYM_VALUE(NODE)))
 #define SYM_VALUE_I(NODE)     (VALUE_I(SYM_VALUE(NODE)))
@@ -118,9 +121,10 @@ struct ast_symbol {
     int sclass;
     unsigned defined : 1;
     unsigned predefine : 1;
+    unsigned gen;               // tags: generation of the definition
     union value value;
     unsigned refs;
-    union x x;
+    struct sym_x *x;
 };
 
 #define DECL_SYM(NODE)          ((NODE)->decl.sym)
@@ -132,7 +136,7 @@ struct ast_decl {
     node_t *sym;                // the symbol
     node_t *body;                // the initializer expr or func body
     node_t **exts;
-    union x x;
+    struct decl_x *x;
 };
 
 #define EXPR_OP(NODE)           ((NODE)->expr.op)
@@ -141,6 +145,8 @@ struct ast_decl {
 #define EXPR_ARGS(NODE)         ((NODE)->expr.list)
 #define EXPR_INITS(NODE)        ((NODE)->expr.list)
 #define EXPR_SYM(NODE)          ((NODE)->expr.sym)
+// the number of holes a VINIT_EXPR stands for
+#define EXPR_VINIT_LEN(NODE)    ((NODE)->expr.op)
 // conditional expr
 #define EXPR_COND(NODE)         EXPR_OPERAND(NODE, 0)
 #define EXPR_THEN(NODE)         EXPR_OPERAND(NODE, 1)
@@ -156,7 +162,7 @@ struct ast_expr {
     node_t *sym;
     node_t *operands[3];
     node_t **list;
-    union x x;
+    struct expr_x *x;
 };
 
 // compound stmt
@@ -201,7 +207,7 @@ struct ast_stmt {
     long index;
     node_t **blks;
     node_t *list[4];
-    union x x;
+    struct stmt_x *x;
 };
 
 union ast_node {
@@ -228,13 +234,12 @@ extern node_t *ast_uop(int op, node_t * ty, node_t * l);
 extern node_t *ast_bop(int op, node_t * ty, node_t * l, node_t * r);
 extern node_t *ast_conv(node_t * ty, node_t * l);
 extern node_t *ast_inits(node_t * ty, struct source src);
-extern node_t *ast_vinit(void);
+extern node_t *ast_vinit(int n);
 // stmt
 extern node_t *ast_stmt(int id, struct source src);
 
-extern const char *gen_label(void);
+extern long gen_label(void);
 extern const char *gen_tmpname(void);
-extern const char *gen_tmpname_r(void);
 extern const char *gen_static_label(void);
 extern const char *gen_compound_label(void);
 extern const char *gen_sliteral_label(void);
@@ -1,6 +1,7 @@
 #include "cc.h"
+#include "sys/sys.h"
 
-static FILE *outfp;
+static THREAD_LOCAL FILE *outfp;
 
 static void cc_init(const char *ifile, const char *ofile)
 {
@@ -41,25 +42,39 @@ static void preprocess(void)
     }
 }
 
-static void cc_exit(void)
+// exit() flushes the output if the unit dies early
+static void cc_exit(const char *ofile)
 {
-    if (outfp != stdout)
-        fclose(outfp);
+    if (outfp == stdout)
+        return;
+    bool failed = ferror(outfp);
+    if (fclose(outfp) != 0 || failed) {
+        struct source src = {.file = ofile };
+        errorf(src, "can't write the output: %s", strerror(errno));
+        // don't leave a truncated output behind
+        if (isfile(ofile))
+            remove(ofile);
+    }
 }
 
 int cc_main(const char *ifile, const char *ofile)
 {
-    atexit(cc_exit);
     cc_init(ifile, ofile);
     input_init(ifile);
     cpp_init(opts.cpp_options);
     type_init();
     symbol_init();
 
-    if (opts.E)
+    if (opts.emit_pch)
+        emit_pch(outfp);
+    else if (opts.E)
         preprocess();
     else
         translate();
 
+    if (opts.fmacro_stats)
+        print_macro_stats();
+
+    cc_exit(ofile);
     return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -21,10 +21,25 @@
 #include "utils/utils.h"
 
 // alloc.c
-extern void *alloc_node(void);
+extern void *alloc_node(size_t size);
 extern void *alloc_token(void);
 extern void *alloc_macro(void);
 
+enum {
+    REGION_TU,
+    REGION_FUNC,
+    REGION_SCRATCH,
+    REGIONS
+};
+
+struct region;
+extern struct region *new_region(void);
+extern void free_region(struct region *r);
+extern void *region_alloc(struct region *r, size_t size);
+extern struct region *set_region(int name, struct region *r);
+extern void *ralloc(int name, size_t size);
+extern void release_region(int name);
+
 // value
 #define VALUE_U(v)    ((v).u)
 #define VALUE_I(v)    ((v).u)
@@ -59,7 +74,6 @@ typedef union ast_node node_t;
 
 // eval.c
 extern node_t *eval(node_t * expr, node_t * ty);
-extern bool eval_cpp_cond(void);
  
 // expr.c
 #define is_assign_op(op)    ((op == '=') || (op >= MULEQ && op <= RSHIFTEQ))
@@ -68,6 +82,7 @@ extern node_t *assign_expr(void);
 extern long intexpr1(node_t * ty);
 extern long intexpr(void);
 extern bool islvalue(node_t * node);
+extern unsigned long long char_value(struct token *t);
 extern node_t *assignconv(node_t * ty, node_t * node);
 // for expression in conditional statement
 extern node_t *bool_expr(void);
@@ -97,7 +112,7 @@ extern void init_string(node_t * ty, node_t * node);
 extern bool has_static_extent(node_t * sym);
 
 // stmt.c
-extern struct vector *funcalls;
+extern THREAD_LOCAL struct vector *funcalls;
 extern void func_body(node_t *decl);
 extern node_t *make_localvar(const char *name, node_t * ty, int sclass);
 
@@ -116,6 +131,7 @@ extern node_t *new_field(void);
 extern node_t *array_type(node_t * ty);
 extern node_t *ptr_type(node_t * ty);
 extern node_t *func_type(void);
+extern node_t *canonical(node_t * ty);
 extern node_t *tag_type(int t, const char *tag, struct source src);
 extern void set_typesize(node_t * ty);
 extern node_t *find_field(node_t * ty, const char *name);
@@ -126,23 +142,23 @@ extern int qual_union(node_t * ty1, node_t * ty2);
 extern bool isincomplete(node_t * ty);
 extern node_t *unpack(node_t * ty);
 
-extern node_t *chartype;        // char
-extern node_t *unsignedchartype;        // unsigned char
-extern node_t *signedchartype;        // signed char
-extern node_t *wchartype;        // wchar_t
-extern node_t *shorttype;        // short (int)
-extern node_t *unsignedshorttype;        // unsigned short (int)
-extern node_t *inttype;                // int
-extern node_t *unsignedinttype;        // unsigned (int)
-extern node_t *longtype;        // long
-extern node_t *unsignedlongtype;        // unsigned long (int)
-extern node_t *longlongtype;        // long long (int)
-extern node_t *unsignedlonglongtype;        // unsigned long long (int)
-extern node_t *floattype;        // float
-extern node_t *doubletype;        // double
-extern node_t *longdoubletype;        // long double
-extern node_t *voidtype;        // void
-extern node_t *booltype;        // bool
+extern THREAD_LOCAL node_t *chartype;        // char
+extern THREAD_LOCAL node_t *unsignedchartype;        // unsigned char
+extern THREAD_LOCAL node_t *signedchartype;        // signed char
+extern THREAD_LOCAL node_t *wchartype;        // wchar_t
+extern THREAD_LOCAL node_t *shorttype;        // short (int)
+extern THREAD_LOCAL node_t *unsignedshorttype;        // unsigned short (int)
+extern THREAD_LOCAL node_t *inttype;                // int
+extern THREAD_LOCAL node_t *unsignedinttype;        // unsigned (int)
+extern THREAD_LOCAL node_t *longtype;        // long
+extern THREAD_LOCAL node_t *unsignedlongtype;        // unsigned long (int)
+extern THREAD_LOCAL node_t *longlongtype;        // long long (int)
+extern THREAD_LOCAL node_t *unsignedlonglongtype;        // unsigned long long (int)
+extern THREAD_LOCAL node_t *floattype;        // float
+extern THREAD_LOCAL node_t *doubletype;        // double
+extern THREAD_LOCAL node_t *longdoubletype;        // long double
+extern THREAD_LOCAL node_t *voidtype;        // void
+extern THREAD_LOCAL node_t *booltype;        // bool
 
 #define BITS(bytes)     (CHAR_BIT * (bytes))
 #define BYTES(bits)     ((ROUNDUP(bits, CHAR_BIT)) / (CHAR_BIT))
@@ -213,14 +229,11 @@ enum {
 };
 
 struct table {
-    int scope;
-    struct table *up;
-    struct map *map;
+    int index;                  // of its bindings in struct ident
+    struct binding *top;        // bindings, innermost scope first
 };
 
 // sym
-extern struct table *new_table(struct table *up, int scope);
-extern void free_table(struct table *t);
 extern void symbol_init(void);
 extern int scopelevel(void);
 extern void enter_scope(void);
@@ -229,17 +242,26 @@ extern bool is_current_scope(node_t *sym);
 extern bool is_anonymous(const char *name);
 
 // create an anonymous symbol
-extern node_t *anonymous(struct table **tpp, int scope);
+extern node_t *anonymous(struct table *table, int scope);
 
-// look up a symbol from this table to previous one, and so on
+// look up the innermost visible symbol
 extern node_t *lookup(const char *name, struct table *table);
 
 // install a symbol with specified scope
-extern node_t *install(const char *name, struct table **tpp, int scope);
+extern node_t *install(const char *name, struct table *table, int scope);
+
+// make an existing symbol visible again in its scope
+extern void bind(node_t *sym, struct table *table);
+
+// hide globals of later generations, see sym.c
+extern unsigned new_generation(void);
+extern unsigned current_generation(void);
+extern void hide_generations(unsigned gen);
+extern bool is_hidden(unsigned gen);
 
-extern struct table *identifiers;
-extern struct table *constants;
-extern struct table *tags;
+extern THREAD_LOCAL struct table *identifiers;
+extern THREAD_LOCAL struct table *constants;
+extern THREAD_LOCAL struct table *tags;
 
 #define SCOPE  scopelevel()
 
@@ -257,8 +279,8 @@ enum {
     ERR,                    // error
     FTL,                    // fatal
 };
-extern unsigned errors;
-extern unsigned warnings;
+extern THREAD_LOCAL unsigned errors;
+extern THREAD_LOCAL unsigned warnings;
 extern void warningf(struct source src, const char *fmt, ...);
 extern void errorf(struct source src, const char *fmt, ...);
 extern void fatalf(struct source src, const char *fmt, ...);
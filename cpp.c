@@ -12,14 +12,29 @@
 static struct token *expand(void);
 static struct vector *expandv(struct vector *v);
 static inline void include_file(const char *file, bool std);
-static struct map *macros;
-static struct vector *std_include_paths;
-static struct vector *usr_include_paths;
-static struct tm now;
+static THREAD_LOCAL struct vector *macro_names;  // ever defined, for emit_pch
+static THREAD_LOCAL struct vector *std_include_paths;
+static THREAD_LOCAL struct vector *usr_include_paths;
+static THREAD_LOCAL struct tm now;
+static THREAD_LOCAL struct map *headers;
+static THREAD_LOCAL const char *config;  // options of a pch, see pch_options
 static struct token *token_zero = &(struct token){.id = NCONSTANT,.name = "0" };
 static struct token *token_one = &(struct token){.id = NCONSTANT,.name = "1" };
 
-static struct token *lineno0;
+static THREAD_LOCAL struct token *lineno0;
+
+/**
+ * -fmacro-stats: expansions of each macro and the tokens
+ * they produce. The time includes collecting the arguments
+ * and pre-expanding them, but not the rescan.
+ */
+struct macro_stat {
+    const char *name;
+    unsigned count;
+    unsigned long tokens;
+    double time;
+};
+static THREAD_LOCAL struct map *macro_stats;
 
 static struct macro *new_macro(int kind)
 {
@@ -28,9 +43,23 @@ static struct macro *new_macro(int kind)
     return m;
 }
 
+// the macros hang off the names' struct ident
+static inline struct macro *find_macro(const char *name)
+{
+    return ident(name)->macro;
+}
+
+static void set_macro(const char *name, struct macro *m)
+{
+    struct ident *id = ident(name);
+    if (m && !id->macro)
+        vec_push(macro_names, (char *)name);
+    id->macro = m;
+}
+
 static inline bool defined(const char *name)
 {
-    return map_get(macros, name);
+    return find_macro(name);
 }
 
 static struct token *skip_spaces(void)
@@ -119,6 +148,449 @@ static struct vector *read_if_tokens(void)
     return v;
 }
 
+/* #if expression evaluator
+ *
+ * C99 6.10.1.4: the controlling expression is evaluated in
+ * intmax_t/uintmax_t. The pp-tokens are evaluated directly with
+ * shunting-yard, using fixed stacks, without building the AST.
+ */
+#define IF_STACK_MAX    64
+
+struct ifval {
+    uintmax_t v;
+    bool u;                        // uintmax_t
+};
+
+struct ifop {
+    int id;
+    int prec;
+    bool unary:1;
+    bool skip:1;                // following operand is unevaluated
+};
+
+struct ifeval {
+    struct ifval vals[IF_STACK_MAX];
+    struct ifop ops[IF_STACK_MAX];
+    int nvals;
+    int nops;
+    int skip;                        // unevaluated depth
+    bool err;
+    struct source src;
+};
+
+#define IF_UNARY_PREC    11
+#define IF_COND_PREC     0
+
+static int if_prec(int id)
+{
+    switch (id) {
+    case '*':
+    case '/':
+    case '%':
+        return 10;
+    case '+':
+    case '-':
+        return 9;
+    case LSHIFT:
+    case RSHIFT:
+        return 8;
+    case '<':
+    case '>':
+    case LEQ:
+    case GEQ:
+        return 7;
+    case EQ:
+    case NEQ:
+        return 6;
+    case '&':
+        return 5;
+    case '^':
+        return 4;
+    case '|':
+        return 3;
+    case AND:
+        return 2;
+    case OR:
+        return 1;
+    case '?':
+    case ':':
+        return IF_COND_PREC;
+    default:
+        return -1;
+    }
+}
+
+static bool if_suffix(const char *s, bool *u)
+{
+    bool uns = false, lng = false;
+    while (*s) {
+        if ((*s == 'u' || *s == 'U') && !uns) {
+            uns = true;
+            s++;
+        } else if ((*s == 'l' || *s == 'L') && !lng) {
+            lng = true;
+            s += s[1] == s[0] ? 2 : 1;
+        } else {
+            return false;
+        }
+    }
+    *u = uns;
+    return true;
+}
+
+static bool if_number(struct ifeval *e, struct token *t, struct ifval *val)
+{
+    const char *s = t->name;
+    int base = 10;
+    uintmax_t n = 0;
+    bool overflow = false;
+    bool valid = true;
+    bool u;
+
+    if (s[0] == '\'' || s[0] == 'L') {
+        // character constants have type int
+        val->v = char_value(t);
+        val->u = false;
+        return true;
+    }
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    } else if (s[0] == '0') {
+        base = 8;
+    }
+
+    const char *digits = s;
+    for (;; s++) {
+        int d;
+        if (isdigit(*s))
+            d = *s - '0';
+        else if (base == 16 && isxdigit(*s))
+            d = (*s & 0x5f) - 'A' + 10;
+        else
+            break;
+        if (d >= base) {
+            valid = false;
+            continue;
+        }
+        if (n > (UINTMAX_MAX - d) / base)
+            overflow = true;
+        else
+            n = n * base + d;
+    }
+
+    if (*s == '.' ||
+        (base == 16 ? (*s == 'p' || *s == 'P') : (*s == 'e' || *s == 'E'))) {
+        errorf(e->src,
+               "floating constant in preprocessor expression: %s",
+               t->name);
+        return false;
+    }
+    if (base == 16 && s == digits) {
+        errorf(e->src, "incomplete hex constant: %s", t->name);
+        return false;
+    }
+    if (!valid) {
+        errorf(e->src, "invalid octal constant %s", t->name);
+        return false;
+    }
+    if (!if_suffix(s, &u)) {
+        errorf(e->src, "invalid suffix '%s' on integer constant", s);
+        return false;
+    }
+    if (n > INTMAX_MAX && !u) {
+        // decimal constants never become unsigned implicitly
+        if (base == 10)
+            overflow = true;
+        u = true;
+    }
+    if (overflow) {
+        errorf(e->src, "integer constant overflow: %s", t->name);
+        return false;
+    }
+
+    val->v = n;
+    val->u = u;
+    return true;
+}
+
+static uintmax_t if_shift(int op, struct ifval l, struct ifval r)
+{
+    const intmax_t bits = sizeof(uintmax_t) * CHAR_BIT;
+    intmax_t n = r.u && r.v > INTMAX_MAX ? INTMAX_MAX : (intmax_t) r.v;
+
+    // shift by a negative count goes the other way
+    if (n < 0) {
+        op = op == LSHIFT ? RSHIFT : LSHIFT;
+        n = n == INTMAX_MIN ? INTMAX_MAX : -n;
+    }
+    if (op == LSHIFT)
+        return n >= bits ? 0 : l.v << n;
+    if (l.u || (intmax_t) l.v >= 0)
+        return n >= bits ? 0 : l.v >> n;
+    return n >= bits ? UINTMAX_MAX : (uintmax_t) ((intmax_t) l.v >> n);
+}
+
+static struct ifval if_binary(struct ifeval *e, int op,
+                              struct ifval l, struct ifval r)
+{
+    bool u = l.u || r.u;
+    struct ifval v = {.u = u };
+
+#define IF_CMP(o)  (u ? l.v o r.v : (intmax_t) l.v o (intmax_t) r.v)
+
+    switch (op) {
+    case '*':
+        v.v = l.v * r.v;
+        break;
+    case '/':
+    case '%':
+        if (r.v == 0) {
+            // an unevaluated operand may divide by zero
+            if (!e->skip) {
+                errorf(e->src,
+                       "division by zero in preprocessor expression");
+                e->err = true;
+            }
+            v.v = 0;
+        } else if (u) {
+            v.v = op == '/' ? l.v / r.v : l.v % r.v;
+        } else if ((intmax_t) l.v == INTMAX_MIN && (intmax_t) r.v == -1) {
+            v.v = op == '/' ? l.v : 0;
+        } else {
+            intmax_t a = l.v, b = r.v;
+            v.v = op == '/' ? a / b : a % b;
+        }
+        break;
+    case '+':
+        v.v = l.v + r.v;
+        break;
+    case '-':
+        v.v = l.v - r.v;
+        break;
+    case LSHIFT:
+    case RSHIFT:
+        v.u = l.u;
+        v.v = if_shift(op, l, r);
+        break;
+    case '&':
+        v.v = l.v & r.v;
+        break;
+    case '^':
+        v.v = l.v ^ r.v;
+        break;
+    case '|':
+        v.v = l.v | r.v;
+        break;
+    // the rest have type int
+    case '<':
+        v = (struct ifval){.v = IF_CMP(<)};
+        break;
+    case '>':
+        v = (struct ifval){.v = IF_CMP(>)};
+        break;
+    case LEQ:
+        v = (struct ifval){.v = IF_CMP(<=)};
+        break;
+    case GEQ:
+        v = (struct ifval){.v = IF_CMP(>=)};
+        break;
+    case EQ:
+        v = (struct ifval){.v = l.v == r.v};
+        break;
+    case NEQ:
+        v = (struct ifval){.v = l.v != r.v};
+        break;
+    case AND:
+        v = (struct ifval){.v = l.v && r.v};
+        break;
+    case OR:
+        v = (struct ifval){.v = l.v || r.v};
+        break;
+    default:
+        assert(0);
+    }
+
+#undef IF_CMP
+
+    return v;
+}
+
+// reduce the top operator
+static void if_reduce(struct ifeval *e)
+{
+    struct ifop op = e->ops[--e->nops];
+    struct ifval *vals = e->vals;
+    struct ifval r = vals[--e->nvals];
+
+    if (op.skip)
+        e->skip--;
+
+    if (op.unary) {
+        switch (op.id) {
+        case '+':
+            break;
+        case '-':
+            r.v = -r.v;
+            break;
+        case '~':
+            r.v = ~r.v;
+            break;
+        case '!':
+            r = (struct ifval){.v = !r.v};
+            break;
+        default:
+            assert(0);
+        }
+    } else if (op.id == ':') {
+        struct ifval l = vals[--e->nvals];
+        struct ifval c = vals[--e->nvals];
+        bool u = l.u || r.u;
+        r = c.v ? l : r;
+        r.u = u;
+    } else {
+        struct ifval l = vals[--e->nvals];
+        r = if_binary(e, op.id, l, r);
+    }
+
+    vals[e->nvals++] = r;
+}
+
+static bool if_push(struct ifeval *e, struct ifop op)
+{
+    if (e->nops == IF_STACK_MAX) {
+        errorf(e->src, "preprocessor expression nested too deeply");
+        return false;
+    }
+    if (op.skip)
+        e->skip++;
+    e->ops[e->nops++] = op;
+    return true;
+}
+
+static bool if_expr(struct vector *tokens)
+{
+    struct ifeval e = {.src = source };
+    bool operand = true;
+    size_t n = vec_len(tokens);
+
+    for (size_t i = 0; i <= n && !e.err; i++) {
+        struct token *t = i < n ? vec_at(tokens, i) : NULL;
+        if (t && t->src.file)
+            e.src = t->src;
+
+        if (operand) {
+            if (t == NULL) {
+                errorf(e.src, "expect expression");
+                return false;
+            }
+            switch (t->id) {
+            case NCONSTANT:
+                if (e.nvals == IF_STACK_MAX) {
+                    errorf(e.src,
+                           "preprocessor expression nested too deeply");
+                    return false;
+                }
+                if (!if_number(&e, t, &e.vals[e.nvals]))
+                    return false;
+                e.nvals++;
+                operand = false;
+                break;
+            case '(':
+            case '+':
+            case '-':
+            case '~':
+            case '!':
+                if (!if_push(&e, (struct ifop){
+                            .id = t->id,
+                            .prec = IF_UNARY_PREC,
+                            .unary = t->id != '('}))
+                    return false;
+                break;
+            default:
+                errorf(e.src,
+                       "invalid token '%s' in preprocessor expression",
+                       t->name);
+                return false;
+            }
+            continue;
+        }
+
+        if (t == NULL || t->id == ')') {
+            while (e.nops && e.ops[e.nops - 1].id != '(') {
+                if (e.ops[e.nops - 1].id == '?') {
+                    errorf(e.src, "expect ':' in conditional expression");
+                    return false;
+                }
+                if_reduce(&e);
+            }
+            if (t == NULL) {
+                if (e.nops) {
+                    errorf(e.src, "missing ')' in preprocessor expression");
+                    return false;
+                }
+                break;
+            }
+            if (e.nops == 0) {
+                errorf(e.src, "missing '(' in preprocessor expression");
+                return false;
+            }
+            e.nops--;
+            continue;
+        }
+
+        int prec = if_prec(t->id);
+        if (prec < 0) {
+            errorf(e.src, "missing binary operator before token '%s'",
+                   t->name);
+            return false;
+        }
+
+        // '?:' is right associative, the others are left associative
+        while (e.nops) {
+            struct ifop *top = &e.ops[e.nops - 1];
+            if (top->id == '(' || top->id == '?' ||
+                top->prec < prec || (top->prec == prec && prec == IF_COND_PREC))
+                break;
+            if_reduce(&e);
+        }
+
+        struct ifval *top = &e.vals[e.nvals - 1];
+        if (t->id == ':') {
+            // reduce the middle operand
+            while (e.nops && e.ops[e.nops - 1].id != '?') {
+                if (e.ops[e.nops - 1].id == '(')
+                    break;
+                if_reduce(&e);
+            }
+            if (e.nops == 0 || e.ops[e.nops - 1].id != '?') {
+                errorf(e.src, "':' without preceding '?'");
+                return false;
+            }
+            struct ifop *op = &e.ops[e.nops - 1];
+            if (op->skip)
+                e.skip--;
+            op->id = ':';
+            op->skip = e.vals[e.nvals - 2].v != 0;
+            if (op->skip)
+                e.skip++;
+        } else {
+            bool skip = false;
+            if (t->id == AND || t->id == '?')
+                skip = top->v == 0;
+            else if (t->id == OR)
+                skip = top->v != 0;
+            if (!if_push(&e, (struct ifop){
+                        .id = t->id,.prec = prec,.skip = skip}))
+                return false;
+        }
+        operand = true;
+    }
+
+    return !e.err && e.vals[0].v != 0;
+}
+
 static bool eval_constexpr(void)
 {
     SAVE_ERRORS;
@@ -126,22 +598,7 @@ static bool eval_constexpr(void)
     if (HAS_ERROR)
         return false;
 
-    // save parser context
-    struct token *saved_token = token;
-    struct token *saved_ahead = ahead_token;
-
-    // create a temp file
-    // so that get_pptok will not
-    // generate 'unterminated conditional directive'
-    file_stub(with_buffer(vec_reverse(tokens)));
-    bool ret = eval_cpp_cond();
-    file_unstub();
-
-    // restore context
-    token = saved_token;
-    ahead_token = saved_ahead;
-
-    return ret;
+    return if_expr(tokens);
 }
 
 static void if_section(void)
@@ -308,7 +765,7 @@ static struct vector *arg(void)
             continue;
         }
         if (space)
-            vec_push(v, space_token);
+            vec_push(v, &space_token);
         if (((t->id == ',' || t->id == ')') && parens == 0) ||
             t->id == EOI)
             break;
@@ -463,23 +920,23 @@ static inline void add_macro(const char *name, struct macro *m)
         if (!strcmp(name, builtins[i]))
             m->builtin = true;
     }
-    map_put(macros, name, m);
+    set_macro(name, m);
 }
 
 static inline void remove_macro(const char *name)
 {
-    struct macro *m = map_get(macros, name);
+    struct macro *m = find_macro(name);
     if (m && m->builtin)
         error("Can't undefine predefined macro '%s'", name);
     else
-        map_put(macros, name, NULL);
+        set_macro(name, NULL);
 }
 
 static void ensure_macro_def(struct token *t, struct macro *m)
 {
     // check redefinition
     const char *name = t->name;
-    struct macro *m1 = map_get(macros, name);
+    struct macro *m1 = find_macro(name);
     if (m1) {
         if (m1->builtin) {
             errorf(t->src, "Can't redefine predefined macro '%s'",
@@ -776,7 +1233,7 @@ static struct vector *expandv(struct vector *v)
     // create a temp file
     // so that get_pptok will not
     // generate 'unterminated conditional directive'
-    file_stub(with_buffer(vec_reverse(v)));
+    file_stub(with_buffer(v));
     for (;;) {
         struct token *t = expand();
         if (t->id == EOI)
@@ -818,7 +1275,8 @@ static struct vector *hsadd(struct vector *r, struct hideset *hideset)
 
 /**
  * Paste last of left side with first of right side.
- * The 'rs' is selected with no leading spaces and trailing spaces.
+ * The 'rs' is selected with no leading spaces and trailing spaces,
+ * it's shared and left unchanged.
  */
 static struct vector *glue(struct vector *ls, struct vector *rs)
 {
@@ -836,14 +1294,18 @@ static struct vector *glue(struct vector *ls, struct vector *rs)
     }
 
     struct token *ltok = vec_pop(ls);
-    struct token *rtok = vec_pop_front(rs);
-    const char *str = format("%s%s", ltok->name, rtok->name);
+    struct token *rtok = vec_head(rs);
+    size_t len = strlen(ltok->name) + strlen(rtok->name) + 1;
+    char *str = ralloc(REGION_SCRATCH, len);
+    snprintf(str, len, "%s%s", ltok->name, rtok->name);
     struct token *t = with_temp_lex(str);
+    release_region(REGION_SCRATCH);
     t->hideset = hideset_intersection(ltok->hideset, rtok->hideset);
 
     vec_add(r, ls);
     vec_push(r, t);
-    vec_add(r, rs);
+    for (int i = 1; i < vec_len(rs); i++)
+        vec_push(r, vec_at(rs, i));
     return r;
 }
 
@@ -881,22 +1343,46 @@ static struct token *stringize(struct vector *v)
     }
     strbuf_cats(s, "\"");
     return new_token(&(struct token) {
-            .id = SCONSTANT,.name = s->str});
+            .id = SCONSTANT,.name = strs(s->str)});
 }
 
+/**
+ * Arguments of a macro invocation. The selected and the
+ * expanded form of an argument are computed at most once,
+ * and shared by all occurrences of the parameter.
+ */
+struct actuals {
+    struct vector *args;
+    struct vector **selected;
+    struct vector **expanded;
+};
+
 /**
  * Select an argument for expansion.
  * Remove the leading and trailing spaces.
  */
-static struct vector *select(struct vector *args, int index)
+static struct vector *select(struct actuals *a, int index)
 {
+    if (a->selected[index])
+        return a->selected[index];
+
+    struct vector *arg = vec_at_safe(a->args, index);
+    size_t i = 0, j = vec_len(arg);
+    while (i < j && IS_SPACE(vec_at(arg, i)))
+        i++;
+    while (j > i && IS_SPACE(vec_at(arg, j - 1)))
+        j--;
     struct vector *v = vec_new();
-    vec_add(v, vec_at_safe(args, index));
-    while (vec_len(v) && IS_SPACE(vec_head(v)))
-        vec_pop_front(v);
-    while (vec_len(v) && IS_SPACE(vec_tail(v)))
-        vec_pop(v);
-    return v;
+    for (; i < j; i++)
+        vec_push(v, vec_at(arg, i));
+    return a->selected[index] = v;
+}
+
+static struct vector *expand_arg(struct actuals *a, int index)
+{
+    if (a->expanded[index] == NULL)
+        a->expanded[index] = expandv(select(a, index));
+    return a->expanded[index];
 }
 
 static struct vector *subst(struct macro *m, struct vector *args,
@@ -904,8 +1390,16 @@ static struct vector *subst(struct macro *m, struct vector *args,
 {
     struct vector *r = vec_new();
     struct vector *body = m->body;
+    // __VA_ARGS__ follows the named parameters
+    size_t nparams = vec_len(m->params) + m->vararg;
+    struct actuals actuals = {.args = args };
+    struct actuals *a = &actuals;
+    if (nparams) {
+        a->selected = xcalloc(nparams, sizeof(struct vector *));
+        a->expanded = xcalloc(nparams, sizeof(struct vector *));
+    }
 
-#define PUSH_SPACE(r, t)    if (t->space) vec_push(r, space_token)
+#define PUSH_SPACE(r, t)    if (t->space) vec_push(r, &space_token)
 
     for (int i = 0; i < vec_len(body); i++) {
         struct token *t0 = vec_at(body, i);
@@ -914,7 +1408,7 @@ static struct vector *subst(struct macro *m, struct vector *args,
 
         if (t0->id == '#' && (index = inparams(t1, m)) >= 0) {
 
-            struct vector *iv = select(args, index);
+            struct vector *iv = select(a, index);
             struct token *ot = stringize(iv);
             PUSH_SPACE(r, t0);
             vec_push(r, ot);
@@ -923,7 +1417,7 @@ static struct vector *subst(struct macro *m, struct vector *args,
         } else if (t0->id == SHARPSHARP
                    && (index = inparams(t1, m)) >= 0) {
 
-            struct vector *iv = select(args, index);
+            struct vector *iv = select(a, index);
             if (vec_len(iv))
                 r = glue(r, iv);
             i++;
@@ -938,19 +1432,19 @@ static struct vector *subst(struct macro *m, struct vector *args,
                    && (t1 && t1->id == SHARPSHARP)) {
 
             hideset = t1->hideset;
-            struct vector *iv = select(args, index);
+            struct vector *iv = select(a, index);
             if (vec_len(iv)) {
                 PUSH_SPACE(r, t0);
                 vec_add(r, iv);
             } else {
                 // add a space
-                vec_push(r, space_token);
+                vec_push(r, &space_token);
 
                 struct token *t2 = vec_at_safe(body, i + 2);
                 int index2 = inparams(t2, m);
                 if (index2 >= 0) {
                     struct vector *iv2 =
-                        select(args, index2);
+                        select(a, index2);
                     vec_add(r, iv2);
                     i++;
                 }
@@ -959,8 +1453,7 @@ static struct vector *subst(struct macro *m, struct vector *args,
 
         } else if ((index = inparams(t0, m)) >= 0) {
 
-            struct vector *iv = select(args, index);
-            struct vector *ov = expandv(iv);
+            struct vector *ov = expand_arg(a, index);
             PUSH_SPACE(r, t0);
             vec_add(r, ov);
 
@@ -969,9 +1462,29 @@ static struct vector *subst(struct macro *m, struct vector *args,
             vec_push(r, t0);
         }
     }
+    free(a->selected);
+    free(a->expanded);
     return hsadd(r, hideset);
 }
 
+static void count_expansion(const char *name, struct vector *v,
+                            double start)
+{
+    double time = wall_time() - start;
+    struct macro_stat *s = map_get(macro_stats, name);
+    if (s == NULL) {
+        s = zmalloc(sizeof(struct macro_stat));
+        s->name = name;
+        map_put(macro_stats, name, s);
+    }
+    s->count++;
+    s->time += time;
+    for (int i = 0; i < vec_len(v); i++) {
+        if (!IS_SPACE(vec_at(v, i)))
+            s->tokens++;
+    }
+}
+
 static struct token *expand(void)
 {
     struct token *t = lex();
@@ -979,15 +1492,18 @@ static struct token *expand(void)
         return t;
 
     const char *name = t->name;
-    struct macro *m = map_get(macros, name);
+    struct macro *m = find_macro(name);
     if (m == NULL || hideset_has(t->hideset, name))
         return t;
 
+    double start = opts.fmacro_stats ? wall_time() : 0;
     switch (m->kind) {
     case MACRO_OBJ:
         {
             struct hideset *hdset = hideset_add(t->hideset, name);
             struct vector *v = subst(m, NULL, hdset);
+            if (opts.fmacro_stats)
+                count_expansion(name, v, start);
             ungetv(v);
             return expand();
         }
@@ -1006,6 +1522,8 @@ static struct token *expand(void)
                                 (t->hideset, rparen->hideset),
                                 name);
                 struct vector *v = subst(m, args, hdset);
+                if (opts.fmacro_stats)
+                    count_expansion(name, v, start);
                 ungetv(v);
                 return expand();
             } else {
@@ -1025,7 +1543,7 @@ static struct token *expand(void)
 static void file_handler(struct token *t)
 {
     const char *file = current_file()->name;
-    const char *name = format("\"%s\"", file);
+    const char *name = strs(format("\"%s\"", file));
     struct token *tok = new_token(&(struct token){.id = SCONSTANT,.name =
                 name,.src = t->src });
     unget(tok);
@@ -1045,7 +1563,7 @@ static void date_handler(struct token *t)
     // mmm dd yyyy
     char ch[20];
     strftime(ch, sizeof(ch), "%b %e %Y", &now);
-    const char *name = format("\"%s\"", ch);
+    const char *name = strs(format("\"%s\"", ch));
     struct token *tok = new_token(&(struct token){.id = SCONSTANT,.name =
                 name,.src = t->src });
     unget(tok);
@@ -1056,7 +1574,7 @@ static void time_handler(struct token *t)
     // hh:mm:ss
     char ch[10];
     strftime(ch, sizeof(ch), "%T", &now);
-    const char *name = format("\"%s\"", ch);
+    const char *name = strs(format("\"%s\"", ch));
     struct token *tok = new_token(&(struct token){.id = SCONSTANT,.name =
                 name,.src = t->src });
     unget(tok);
@@ -1112,11 +1630,56 @@ static const char *find_header(const char *name, bool isstd)
     return NULL;
 }
 
+/**
+ * Raw tokens of the headers are cached when included a second
+ * time, keyed by path, modification time and size. The cache
+ * is kept across translation units.
+ */
+struct header {
+    time_t mtime;
+    int size;
+    const char *name;
+    const char *path;
+    unsigned includes;
+    double lextime;                // -fmacro-stats
+    bool uncached:1;        // tokenize failed
+    struct vector *tokens;
+};
+
+static struct file *open_header(const char *path, const char *name)
+{
+    time_t mtime = file_mtime(path);
+    int size = file_size(path);
+    path = strs(path);
+    struct header *h = map_get(headers, path);
+    if (h == NULL || h->mtime != mtime || h->size != size
+        || strcmp(h->name, name)) {
+        h = zmalloc(sizeof(struct header));
+        h->mtime = mtime;
+        h->size = size;
+        h->name = name;
+        h->path = path;
+        map_put(headers, path, h);
+    }
+    h->includes++;
+    if (h->tokens == NULL && !h->uncached && h->includes > 1) {
+        h->tokens = tokenize(path, name);
+        h->uncached = h->tokens == NULL;
+    }
+    struct file *fs;
+    if (h->tokens)
+        fs = with_tokens(h->tokens, name);
+    else
+        fs = with_file(path, name);
+    fs->header = h;
+    return fs;
+}
+
 static void do_include_file(const char *file, const char *name, bool std)
 {
     const char *path = find_header(file, std);
     if (path) {
-        file_sentinel(with_file(path, name ? name : path));
+        file_sentinel(open_header(path, name ? name : path));
         unget(lineno(1, current_file()->name));
     } else {
         if (file)
@@ -1179,12 +1742,85 @@ static void init_include(void)
 #endif
 }
 
+/**
+ * What a precompiled header depends on besides its own text:
+ * the header of the predefined macros and the -D, -U and -I
+ * options in order, one per line.
+ */
+static const char *pch_options(struct vector *options)
+{
+    const char *builtin = BUILD_DIR "/include/mcc.h";
+    struct strbuf *s = strbuf_new();
+    strbuf_cats(s, format("%s@%ld\n", builtin, (long)file_mtime(builtin)));
+    for (int i = 0; i < vec_len(options); i++) {
+        const char *arg = vec_at(options, i);
+        if (!strcmp(arg, "-include-pch"))
+            i++;
+        else if (!strncmp(arg, "-D", 2) || !strncmp(arg, "-U", 2) ||
+                 !strncmp(arg, "-I", 2))
+            strbuf_cats(s, format("%s\n", arg));
+    }
+    const char *r = strs(s->str);
+    strbuf_free(s);
+    return r;
+}
+
+// Reject a precompiled header built with other options.
+static void check_pch_options(struct source src, const char *built,
+                              const char *used)
+{
+    while (*built || *used) {
+        int n1 = strcspn(built, "\n");
+        int n2 = strcspn(used, "\n");
+        if (n1 != n2 || strncmp(built, used, n1)) {
+            if (*used == '\0')
+                fatalf(src, "precompiled header was built with '%.*s'",
+                       n1, built);
+            else if (*built == '\0')
+                fatalf(src, "precompiled header was built without '%.*s'",
+                       n2, used);
+            else
+                fatalf(src, "precompiled header was built with '%.*s' "
+                       "instead of '%.*s'", n1, built, n2, used);
+        }
+        built += n1 + (built[n1] != '\0');
+        used += n2 + (used[n2] != '\0');
+    }
+}
+
+/**
+ * The precompiled header is read after the builtin
+ * macros and the command line, before the input file.
+ */
+static void include_pch(struct vector *options)
+{
+    for (int i = 0; i < vec_len(options); i++) {
+        if (strcmp(vec_at(options, i), "-include-pch"))
+            continue;
+        const char *file = vec_at(options, ++i);
+        struct source src = {.file = file };
+        if (!file_exists(file))
+            fatalf(src, "'%s' file not found", file);
+        struct pch *pch = open_pch(file);
+        if (pch == NULL)
+            fatalf(src, "invalid precompiled header");
+        check_pch_options(src, pch_config(pch), config);
+        struct file *fs = with_tokens(NULL, file);
+        fs->pch = pch;
+        file_sentinel(fs);
+    }
+}
+
 static void parseopts(struct vector *options)
 {
     struct strbuf *s = strbuf_new();
 
     for (int i = 0; i < vec_len(options); i++) {
         const char *arg = vec_at(options, i);
+        if (!strcmp(arg, "-include-pch")) {
+            i++;
+            continue;
+        }
         if (strlen(arg) < 3)
             continue;
         if (!strncmp(arg, "-I", 2)) {
@@ -1222,10 +1858,18 @@ static void parseopts(struct vector *options)
 
 void cpp_init(struct vector *options)
 {
-    macros = map_new();
+    // the macros of an earlier unit of the thread
+    for (int i = 0; macro_names && i < vec_len(macro_names); i++)
+        ident(vec_at(macro_names, i))->macro = NULL;
+    macro_names = vec_new();
+    macro_stats = ptrmap_new();
+    if (!headers)
+        headers = ptrmap_new();
     lineno0 = lineno(1, current_file()->name);
+    config = pch_options(options);
     init_env();
     init_include();
+    include_pch(options);
     builtin_macros();
     parseopts(options);
 }
@@ -1235,12 +1879,21 @@ void cpp_init(struct vector *options)
 struct token *get_pptok(void)
 {
     for (;;) {
-        struct token *t = expand();
+        struct file *fs = current_file();
+        // tokens of a precompiled header are already expanded
+        struct token *t = fs->pch ? pch_token(fs->pch) : expand();
         if (t->id == EOI) {
             struct ifstub *stub = current_ifstub();
             if (stub)
                 errorf(stub->src,
                        "unterminated conditional directive");
+            if (fs->pch) {
+                // the macros are defined at the end of the header
+                pch_define(fs->pch, set_macro);
+                close_pch(fs->pch);
+            }
+            if (fs->header)
+                fs->header->lextime += fs->lextime;
             if (current_file()->stub) {
                 return t;
             } else {
@@ -1266,7 +1919,7 @@ static struct vector *pretty(struct vector *v)
     while (vec_len(v) && (IS_NEWLINE(vec_tail(v)) || IS_SPACE(vec_tail(v))))
         vec_pop(v);
     if (vec_len(v) && !IS_NEWLINE(vec_tail(v)) && !IS_LINENO(vec_tail(v)))
-        vec_push(v, newline_token);
+        vec_push(v, &newline_token);
 
     struct vector *r = vec_new();
     for (int i = 0; i < vec_len(v); i++) {
@@ -1286,6 +1939,40 @@ static struct vector *pretty(struct vector *v)
     return r;
 }
 
+/**
+ * Precompile the input file as a prefix header:
+ * its expanded tokens and the macros at the end.
+ */
+void emit_pch(FILE *fp)
+{
+    struct vector *tokens = vec_new();
+    for (;;) {
+        struct token *t = get_pptok();
+        if (t->id == EOI)
+            break;
+        vec_push(tokens, t);
+    }
+
+    struct map *seen = ptrmap_new();
+    struct vector *names = vec_new();
+    struct vector *defs = vec_new();
+    for (int i = 0; i < vec_len(macro_names); i++) {
+        const char *name = vec_at(macro_names, i);
+        struct macro *m = find_macro(name);
+        // undefined, or listed again after a redefinition
+        if (!m || map_get(seen, name))
+            continue;
+        map_put(seen, name, m);
+        if (m->kind == MACRO_SPECIAL)
+            continue;
+        vec_push(names, (char *)name);
+        vec_push(defs, m);
+    }
+    map_free(seen);
+
+    write_pch(fp, config, tokens, names, defs);
+}
+
 struct vector *all_pptoks(void)
 {
     struct vector *v = vec_new1(lineno0);
@@ -1297,3 +1984,85 @@ struct vector *all_pptoks(void)
     }
     return pretty(v);
 }
+
+/* -fmacro-stats report
+ */
+#define STATS_TOP    20
+
+static int macro_count_cmp(const void *a, const void *b)
+{
+    const struct macro_stat *s1 = *(struct macro_stat **)a;
+    const struct macro_stat *s2 = *(struct macro_stat **)b;
+    return (s1->count < s2->count) - (s1->count > s2->count);
+}
+
+static int macro_tokens_cmp(const void *a, const void *b)
+{
+    const struct macro_stat *s1 = *(struct macro_stat **)a;
+    const struct macro_stat *s2 = *(struct macro_stat **)b;
+    return (s1->tokens < s2->tokens) - (s1->tokens > s2->tokens);
+}
+
+static int macro_time_cmp(const void *a, const void *b)
+{
+    const struct macro_stat *s1 = *(struct macro_stat **)a;
+    const struct macro_stat *s2 = *(struct macro_stat **)b;
+    return (s1->time < s2->time) - (s1->time > s2->time);
+}
+
+static int header_includes_cmp(const void *a, const void *b)
+{
+    const struct header *h1 = *(struct header **)a;
+    const struct header *h2 = *(struct header **)b;
+    return (h1->includes < h2->includes) - (h1->includes > h2->includes);
+}
+
+static int header_time_cmp(const void *a, const void *b)
+{
+    const struct header *h1 = *(struct header **)a;
+    const struct header *h2 = *(struct header **)b;
+    return (h1->lextime < h2->lextime) - (h1->lextime > h2->lextime);
+}
+
+static void print_macros(struct vector *v, const char *title,
+                         int (*cmp) (const void *, const void *))
+{
+    size_t n = MIN(vec_len(v), STATS_TOP);
+    qsort(v->mem, vec_len(v), sizeof(void *), cmp);
+    fprintf(stderr, "\nTop %lu macros by %s:\n", n, title);
+    fprintf(stderr, "%10s %10s %10s  %s\n", "count", "tokens", "time(ms)",
+            "name");
+    for (size_t i = 0; i < n; i++) {
+        struct macro_stat *s = vec_at(v, i);
+        fprintf(stderr, "%10u %10lu %10.3f  %s\n", s->count, s->tokens,
+                s->time * 1000, s->name);
+    }
+}
+
+static void print_headers(struct vector *v, const char *title,
+                          int (*cmp) (const void *, const void *))
+{
+    size_t n = MIN(vec_len(v), STATS_TOP);
+    qsort(v->mem, vec_len(v), sizeof(void *), cmp);
+    fprintf(stderr, "\nTop %lu headers by %s:\n", n, title);
+    fprintf(stderr, "%10s %10s  %s\n", "includes", "lex(ms)", "path");
+    for (size_t i = 0; i < n; i++) {
+        struct header *h = vec_at(v, i);
+        fprintf(stderr, "%10u %10.3f  %s\n", h->includes,
+                h->lextime * 1000, h->path);
+    }
+}
+
+void print_macro_stats(void)
+{
+    struct vector *v = map_values(macro_stats);
+    print_macros(v, "expansions", macro_count_cmp);
+    print_macros(v, "tokens produced", macro_tokens_cmp);
+    print_macros(v, "expansion time", macro_time_cmp);
+    vec_free(v);
+
+    v = map_values(headers);
+    print_headers(v, "include count", header_includes_cmp);
+    print_headers(v, "lex time", header_time_cmp);
+    vec_free(v);
+}
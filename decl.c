@@ -22,6 +22,7 @@ static void ensure_array(node_t * atype, struct source src, int level);
 static void ensure_func(node_t * ftype, struct source src);
 static void ensure_main(node_t *ftype, const char *name, struct source src);
 static struct vector * filter_global(struct vector *v);
+static void parse_lazy_bodies(void);
 
 #define PACK_PARAM(prototype, first, fvoid, sclass)     \
     (((prototype) & 0x01) << 30) |                      \
@@ -341,6 +342,7 @@ static node_t **prototype(node_t *ftype)
         basety = specifiers(&sclass, &fspec);
         param_declarator(&ty, &id);
         attach_type(&ty, basety);
+        ty = canonical(ty);
 
         if (i == 0 && isvoid(ty))
             first_void = true;
@@ -545,6 +547,7 @@ static node_t *tag_decl(void)
             fields(sym);
         match('}', follow);
         SYM_DEFINED(sym) = true;
+        SYM_GEN(sym) = current_generation();
     } else if (id) {
         sym = lookup(id, tags);
         if (sym) {
@@ -576,7 +579,7 @@ static void ids(node_t *sym)
             if (s && is_current_scope(s))
                 redefinition_error(source, s);
 
-            s = install(token->name, &identifiers, SCOPE);
+            s = install(token->name, identifiers, SCOPE);
             SYM_TYPE(s) = SYM_TYPE(sym);
             AST_SRC(s) = source;
             SYM_SCLASS(s) = ENUM;
@@ -627,6 +630,7 @@ static void fields(node_t * sym)
                 struct token *id = NULL;
                 declarator(&ty, &id, NULL);
                 attach_type(&ty, basety);
+                ty = canonical(ty);
                 if (token->id == ':')
                     bitfield(field);
                 FIELD_TYPE(field) = ty;
@@ -881,6 +885,7 @@ static struct vector *decls(declfun_p * dcl)
         else
             declarator(&ty, &id, NULL);
         attach_type(&ty, basety);
+        ty = canonical(ty);
 
         if (level == GLOBAL && params) {
             if (first_funcdef(ty)) {
@@ -916,6 +921,7 @@ static struct vector *decls(declfun_p * dcl)
             // declarator
             declarator(&ty, &id, NULL);
             attach_type(&ty, basety);
+            ty = canonical(ty);
         }
     } else if (isenum(basety) || isstruct(basety) || isunion(basety)) {
         // struct/union/enum
@@ -949,6 +955,7 @@ node_t *typename(void)
         abstract_declarator(&ty);
 
     attach_type(&ty, basety);
+    ty = canonical(ty);
 
     return ty;
 }
@@ -976,6 +983,7 @@ node_t *translation_unit(void)
                 skipto(FARRAY(first_decl));
         }
     }
+    parse_lazy_bodies();
 
     DECL_EXTS(ret) = (node_t **) vtoa(filter_global(v));
     return ret;
@@ -984,8 +992,7 @@ node_t *translation_unit(void)
 static struct vector * filter_global(struct vector *v)
 {
     struct vector *r = vec_new();
-    struct map *map = map_new();
-    map->cmpfn = nocmp;
+    struct map *map = ptrmap_new();
     for (int i = 0; i < vec_len(v); i++) {
         node_t *decl = vec_at(v, i);
         node_t *sym = DECL_SYM(decl);
@@ -1255,7 +1262,7 @@ static node_t * typedefdecl(struct token *t, node_t * ty, int fspec, int kind)
     node_t *sym = lookup(id, identifiers);
     if (sym && is_current_scope(sym))
         redefinition_error(src, sym);
-    sym = install(id, &identifiers, SCOPE);
+    sym = install(id, identifiers, SCOPE);
     SYM_TYPE(sym) = ty;
     AST_SRC(sym) = src;
     SYM_SCLASS(sym) = sclass;
@@ -1334,9 +1341,9 @@ static node_t *paramdecl(struct token *t, node_t * ty, int sclass,
         sym = lookup(id, identifiers);
         if (sym && SYM_SCOPE(sym) == SCOPE)
             redefinition_error(source, sym);
-        sym = install(id, &identifiers, SCOPE);
+        sym = install(id, identifiers, SCOPE);
     } else {
-        sym = anonymous(&identifiers, SCOPE);
+        sym = anonymous(identifiers, SCOPE);
     }
 
     SYM_TYPE(sym) = ty;
@@ -1385,7 +1392,7 @@ static node_t *localdecl(struct token *t, node_t * ty, int sclass,
                     SYM_SCLASS(sym) == EXTERN)))) {
         redefinition_error(src, sym);
     } else {
-        sym = install(id, &identifiers, SCOPE);
+        sym = install(id, identifiers, SCOPE);
         SYM_TYPE(sym) = ty;
         AST_SRC(sym) = src;
         SYM_SCLASS(sym) = sclass;
@@ -1427,7 +1434,7 @@ static node_t *globaldecl(struct token *t, node_t * ty, int sclass,
 
     sym = lookup(id, identifiers);
     if (!sym || SYM_SCOPE(sym) != SCOPE) {
-        sym = install(id, &identifiers, SCOPE);
+        sym = install(id, identifiers, SCOPE);
         SYM_TYPE(sym) = ty;
         AST_SRC(sym) = src;
         SYM_SCLASS(sym) = sclass;
@@ -1519,6 +1526,92 @@ static void make_funcdecl(node_t *sym, node_t *ty, int sclass, struct source src
     DECL_SYM(decl) = sym;
 }
 
+/* Lazy function bodies
+ *
+ * Headers define many static inline functions a translation
+ * unit never calls. The body of such a function is skipped
+ * by brace matching and its tokens are kept. It is parsed
+ * at the end of the translation unit, and only if the
+ * function is referenced by then. The tokens are kept after
+ * macro expansion, so later macro definitions don't affect
+ * them, and globals declared or tags defined after the body
+ * are hidden from it.
+ */
+struct lazy_body {
+    node_t *decl;
+    node_t *ftype;
+    struct vector *tokens;      // from '{' to '}', NULL once parsed
+    unsigned gen;               // started when the body was skipped
+};
+
+static THREAD_LOCAL struct vector *lazy_bodies;
+
+static bool is_lazy(node_t *decl, node_t *ftype, int sclass, int fspec)
+{
+    node_t *sym = DECL_SYM(decl);
+    return sym && sclass == STATIC && fspec == INLINE &&
+        !TYPE_OLDSTYLE(ftype) && !is_top_file(AST_SRC(sym).file);
+}
+
+static void skip_body(node_t *decl, node_t *ftype)
+{
+    struct vector *v = vec_new();
+
+    for (int depth = 0;;) {
+        if (token->id == EOI) {
+            // unterminated, parse it now for the errors
+            unread_tokens(v);
+            func_body(decl);
+            return;
+        }
+        vec_push(v, token);
+        if (token->id == '{')
+            depth++;
+        else if (token->id == '}' && --depth == 0)
+            break;
+        gettok();
+    }
+    gettok();
+
+    struct lazy_body *lazy = zmalloc(sizeof(struct lazy_body));
+    lazy->decl = decl;
+    lazy->ftype = ftype;
+    lazy->tokens = v;
+    lazy->gen = new_generation();
+    if (lazy_bodies == NULL)
+        lazy_bodies = vec_new();
+    vec_push(lazy_bodies, lazy);
+}
+
+// parse the skipped bodies of the referenced functions
+static void parse_lazy_bodies(void)
+{
+    cc_assert(SCOPE == GLOBAL);
+
+    // a parsed body may reference other functions
+    for (bool more = true; more;) {
+        more = false;
+        for (int i = 0; i < vec_len(lazy_bodies); i++) {
+            struct lazy_body *lazy = vec_at(lazy_bodies, i);
+            if (lazy->tokens == NULL ||
+                SYM_REFS(DECL_SYM(lazy->decl)) == 0)
+                continue;
+
+            unread_tokens(lazy->tokens);
+            lazy->tokens = NULL;
+            hide_generations(lazy->gen);
+            enter_scope();
+            node_t **params = TYPE_PARAMS(lazy->ftype);
+            for (int j = 0; j < LIST_LEN(params); j++)
+                bind(params[j], identifiers);
+            func_body(lazy->decl);
+            exit_scope();
+            hide_generations(0);
+            more = true;
+        }
+    }
+}
+
 // token maybe NULL
 static node_t *funcdef(struct token *t, node_t * ftype, int sclass,
                        int fspec)
@@ -1537,7 +1630,7 @@ static node_t *funcdef(struct token *t, node_t * ftype, int sclass,
         struct source src = t->src;
         node_t *sym = lookup(id, identifiers);
         if (!sym || SYM_SCOPE(sym) != GLOBAL) {
-            sym = install(id, &identifiers, GLOBAL);
+            sym = install(id, identifiers, GLOBAL);
             make_funcdecl(sym, ftype, sclass, src, decl);
         } else if (eqtype(ftype, SYM_TYPE(sym)) && !SYM_DEFINED(sym)) {
             if (sclass == STATIC && SYM_SCLASS(sym) != STATIC)
@@ -1555,7 +1648,7 @@ static node_t *funcdef(struct token *t, node_t * ftype, int sclass,
         ensure_main(ftype, id, src);
         ensure_inline(ftype, fspec, src);
     } else {
-        node_t *sym = anonymous(&identifiers, GLOBAL);
+        node_t *sym = anonymous(identifiers, GLOBAL);
         make_funcdecl(sym, ftype, sclass, source, decl);
     }
 
@@ -1568,7 +1661,10 @@ static node_t *funcdef(struct token *t, node_t * ftype, int sclass,
 
     if (token->id == '{') {
         // function definition
-        func_body(decl);
+        if (is_lazy(decl, ftype, sclass, fspec))
+            skip_body(decl, ftype);
+        else
+            func_body(decl);
         exit_scope();
     }
 
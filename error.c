@@ -1,7 +1,7 @@
 #include "cc.h"
 
-unsigned errors;
-unsigned warnings;
+THREAD_LOCAL unsigned errors;
+THREAD_LOCAL unsigned warnings;
 
 #define MAX_ERRORS 32
 
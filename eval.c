@@ -8,173 +8,353 @@
  * 4. initializer (combination of the aboves)
  */
 
-static node_t *scalar_uop(int op, node_t * ty, node_t * l);
-static node_t *arith_uop(int op, node_t * ty, node_t * l);
-static node_t *int_uop(int op, node_t * ty, node_t * l);
-
-static node_t *scalar_bop(int op, node_t * ty, node_t * l, node_t * r);
-static node_t *arith_bop(int op, node_t * ty, node_t * l, node_t * r);
-static node_t *int_bop(int op, node_t * ty, node_t * l, node_t * r);
+/* Arithmetic constants are folded by value: a 'struct cvalue'
+ * is passed around instead of a literal node, so only the
+ * final result gets a node. Integer (and integer pointer)
+ * values are kept in VALUE_U, converted to their type, floating
+ * values in VALUE_D.
+ *
+ * Address constants and initializers are folded on the tree by
+ * doeval(), which shares the arithmetic below.
+ */
+struct cvalue {
+    node_t *type;
+    union value v;
+};
 
 static node_t *doeval(node_t * expr);
 
-static struct bop {
-    int op;
-    bool(*is) (node_t * ty);
-    node_t *(*eval) (int op, node_t * ty, node_t * l, node_t * r);
-} bops[] = {
-    {'%', isint, int_bop},
-    {LSHIFT, isint, int_bop},
-    {RSHIFT, isint, int_bop},
-    {'|', isint, int_bop},
-    {'&', isint, int_bop},
-    {'^', isint, int_bop},
-    {'*', isarith, arith_bop},
-    {'/', isarith, arith_bop},
-    {'+', isarith, arith_bop},
-    {'-', isarith, arith_bop},
-    {'>', isscalar, scalar_bop},
-    {'<', isscalar, scalar_bop},
-    {LEQ, isscalar, scalar_bop},
-    {GEQ, isscalar, scalar_bop},
-    {EQ, isscalar, scalar_bop},
-    {NEQ, isscalar, scalar_bop},};
-
-static struct uop {
-    int op;
-    bool(*is) (node_t * ty);
-    node_t *(*eval) (int op, node_t * ty, node_t * l);
-} uops[] = {
-    {'+', isarith, arith_uop},
-    {'-', isarith, arith_uop},
-    {'~', isint, int_uop},
-    {'!', isscalar, scalar_uop},};
-
-static struct bop *dispatch_bop(int op)
+static bool issigned(node_t * ty)
 {
-    for (int i = 0; i < ARRAY_SIZE(bops); i++) {
-        if (bops[i].op == op)
-            return &bops[i];
-    }
-    return NULL;
+    return TYPE_OP(unpack(ty)) == INT;
 }
 
-static struct uop *dispatch_uop(int op)
+// the value 'v' converted to the integer type 'ty'
+static unsigned long long int_value(node_t * ty, unsigned long long v)
 {
-    for (int i = 0; i < ARRAY_SIZE(uops); i++) {
-        if (uops[i].op == op)
-            return &uops[i];
-    }
-    return NULL;
+    if (isbool(ty))
+        return v != 0;
+
+    int bits = TYPE_SIZE(ty) * 8;
+    if (bits >= 64)
+        return v;
+    unsigned long long mask = (1ULL << bits) - 1;
+    v &= mask;
+    if (issigned(ty) && (v >> (bits - 1)))
+        v |= ~mask;
+    return v;
 }
 
-static node_t *literal_node(int id)
+static bool value_bool(struct cvalue *cv)
 {
-    node_t *n = alloc_node();
-    AST_ID(n) = id;
-    EXPR_SYM(n) = anonymous(&constants, CONSTANT);
-    return n;
+    if (isfloat(cv->type))
+        return VALUE_D(cv->v) != 0;
+    else
+        return VALUE_U(cv->v) != 0;
 }
 
-static node_t *int_literal_node(node_t * ty, union value v)
+static void set_int(struct cvalue *cv, node_t * ty, unsigned long long u)
 {
-    node_t *n = literal_node(INTEGER_LITERAL);
-    AST_TYPE(n) = ty;
-    SYM_TYPE(EXPR_SYM(n)) = ty;
-    SYM_VALUE(EXPR_SYM(n)) = v;
-    return n;
+    cv->type = ty;
+    VALUE_U(cv->v) = isint(ty) ? int_value(ty, u) : u;
 }
 
-static node_t *float_literal_node(node_t * ty, union value v)
+static void set_float(struct cvalue *cv, node_t * ty, long double d)
 {
-    node_t *n = literal_node(FLOAT_LITERAL);
-    AST_TYPE(n) = ty;
-    SYM_TYPE(EXPR_SYM(n)) = ty;
-    SYM_VALUE(EXPR_SYM(n)) = v;
-    return n;
+    cv->type = ty;
+    VALUE_D(cv->v) = d;
 }
 
-static node_t *one_literal(void)
+static bool value_cast(node_t * dty, struct cvalue *cv)
 {
-    static node_t *_one_literal;
-    if (!_one_literal)
-        _one_literal = new_integer_literal(1);
-    return _one_literal;
+    node_t *sty = cv->type;
+
+    if (isint(dty) && isfloat(sty)) {
+        // float => int, any nonzero value is true
+        if (isbool(dty))
+            set_int(cv, dty, VALUE_D(cv->v) != 0);
+        else if (issigned(dty))
+            set_int(cv, dty, (long long)VALUE_D(cv->v));
+        else
+            set_int(cv, dty, VALUE_D(cv->v));
+    } else if (isfloat(dty) && isfloat(sty)) {
+        // float => float
+        int dst_kind = TYPE_KIND(dty);
+        if (dst_kind == FLOAT)
+            set_float(cv, dty, (float)VALUE_D(cv->v));
+        else if (dst_kind == DOUBLE)
+            set_float(cv, dty, (double)VALUE_D(cv->v));
+        else
+            set_float(cv, dty, VALUE_D(cv->v));
+    } else if (isfloat(dty) && isint(sty)) {
+        // int => float
+        if (issigned(sty))
+            set_float(cv, dty, (long long)VALUE_U(cv->v));
+        else
+            set_float(cv, dty, VALUE_U(cv->v));
+    } else if ((isint(dty) || isptr(dty)) && (isint(sty) || isptr(sty))) {
+        // int/ptr => int/ptr
+        set_int(cv, dty, VALUE_U(cv->v));
+    } else {
+        return false;
+    }
+    return true;
 }
 
-static node_t *zero_literal(void)
+static bool value_uop(int op, node_t * ty, struct cvalue *l)
 {
-    static node_t *_zero_literal;
-    if (!_zero_literal)
-        _zero_literal = new_integer_literal(0);
-    return _zero_literal;
+    switch (op) {
+    case '+':
+        if (!isarith(l->type))
+            return false;
+        l->type = ty;
+        return true;
+    case '-':
+        if (isfloat(l->type))
+            set_float(l, ty, -VALUE_D(l->v));
+        else if (isint(l->type))
+            set_int(l, ty, -VALUE_U(l->v));
+        else
+            return false;
+        return true;
+    case '~':
+        if (!isint(l->type))
+            return false;
+        set_int(l, ty, ~VALUE_U(l->v));
+        return true;
+    case '!':
+        set_int(l, inttype, !value_bool(l));
+        return true;
+    default:
+        return false;
+    }
 }
 
-static node_t *arith2arith(node_t * dty, node_t * l)
+static bool value_compare(int op, struct cvalue *l, struct cvalue *r)
 {
-    if (!isiliteral(l) && !isfliteral(l))
-        return NULL;
+    if (isfloat(l->type)) {
+        long double a = VALUE_D(l->v), b = VALUE_D(r->v);
+        switch (op) {
+        case '<': return a < b;
+        case '>': return a > b;
+        case LEQ: return a <= b;
+        case GEQ: return a >= b;
+        case EQ: return a == b;
+        default: return a != b;
+        }
+    } else if (issigned(l->type)) {
+        long long a = VALUE_U(l->v), b = VALUE_U(r->v);
+        switch (op) {
+        case '<': return a < b;
+        case '>': return a > b;
+        case LEQ: return a <= b;
+        case GEQ: return a >= b;
+        case EQ: return a == b;
+        default: return a != b;
+        }
+    } else {
+        unsigned long long a = VALUE_U(l->v), b = VALUE_U(r->v);
+        switch (op) {
+        case '<': return a < b;
+        case '>': return a > b;
+        case LEQ: return a <= b;
+        case GEQ: return a >= b;
+        case EQ: return a == b;
+        default: return a != b;
+        }
+    }
+}
 
-    node_t *sty = AST_TYPE(l);
-    if (isint(dty) && isint(sty)) {
-        union value dst_val = SYM_VALUE(EXPR_SYM(l));
-        int src_size = TYPE_SIZE(sty);
-        int dst_size = TYPE_SIZE(dty);
-        if (src_size > dst_size) {
-            // narrow
-            VALUE_U(dst_val) &= VALUE_U(TYPE_LIMITS_MAX(dty));
-            if (TYPE_KIND(dty) == _BOOL)
-                VALUE_U(dst_val) =
-                    VALUE_U(dst_val) == 0 ? 0 : 1;
+// 'l op r' of type 'ty' into 'l', false if not a constant
+static bool value_bop(int op, node_t * ty, struct cvalue *l, struct cvalue *r)
+{
+    switch (op) {
+    case '<':
+    case '>':
+    case LEQ:
+    case GEQ:
+    case EQ:
+    case NEQ:
+        if (!isscalar(l->type) || !isscalar(r->type))
+            return false;
+        set_int(l, inttype, value_compare(op, l, r));
+        return true;
+    case '+':
+    case '-':
+    case '*':
+    case '/':
+        if (isfloat(ty)) {
+            long double a = VALUE_D(l->v), b = VALUE_D(r->v);
+            switch (op) {
+            case '+': set_float(l, ty, a + b); break;
+            case '-': set_float(l, ty, a - b); break;
+            case '*': set_float(l, ty, a * b); break;
+            default: set_float(l, ty, a / b); break;
+            }
+            return true;
         }
-        return int_literal_node(dty, dst_val);
-    } else if (isint(dty) && isfloat(sty)) {
-        // float => int
-        union value src_val = SYM_VALUE(EXPR_SYM(l));
-        union value dst_val;
-        VALUE_U(dst_val) = VALUE_D(src_val);
-        return int_literal_node(dty, dst_val);
-    } else if (isfloat(dty) && isint(sty)) {
-        // int => float
-        union value src_val = SYM_VALUE(EXPR_SYM(l));
-        union value dst_val;
-        if (TYPE_OP(sty) == INT)
-            VALUE_D(dst_val) = (long long)VALUE_U(src_val);
+        break;
+    case '%':
+    case LSHIFT:
+    case RSHIFT:
+    case '|':
+    case '&':
+    case '^':
+        break;
+    default:
+        return false;
+    }
+
+    // integers
+    if (!isint(ty) || !isint(l->type) || !isint(r->type))
+        return false;
+
+    unsigned long long a = VALUE_U(l->v), b = VALUE_U(r->v);
+    bool sign = issigned(ty);
+    unsigned long long v;
+
+    switch (op) {
+    case '+': v = a + b; break;
+    case '-': v = a - b; break;
+    case '*': v = a * b; break;
+    case '|': v = a | b; break;
+    case '&': v = a & b; break;
+    case '^': v = a ^ b; break;
+    case '/':
+    case '%':
+        if (b == 0)
+            return false;
+        if (sign && (long long)b == -1)
+            v = op == '/' ? -a : 0;
+        else if (sign)
+            v = op == '/' ? (long long)a / (long long)b
+                : (long long)a % (long long)b;
         else
-            VALUE_D(dst_val) = VALUE_U(src_val);
-        return float_literal_node(dty, dst_val);
-    } else if (isfloat(dty) && isfloat(sty)) {
-        // float => float
-        int dst_kind = TYPE_KIND(dty);
-        union value src_val = SYM_VALUE(EXPR_SYM(l));
-        union value dst_val;
-        if (dst_kind == FLOAT)
-            VALUE_D(dst_val) = (float)VALUE_D(src_val);
-        else if (dst_kind == DOUBLE)
-            VALUE_D(dst_val) = (double)VALUE_D(src_val);
+            v = op == '/' ? a / b : a % b;
+        break;
+    case LSHIFT:
+        v = b < 64 ? a << b : 0;
+        break;
+    case RSHIFT:
+        if (sign)
+            v = (long long)a >> (b < 64 ? b : 63);
         else
-            VALUE_D(dst_val) = VALUE_D(src_val);
-        return float_literal_node(dty, dst_val);
+            v = b < 64 ? a >> b : 0;
+        break;
+    default:
+        cc_assert(0);
     }
-    cc_assert(0);
+
+    set_int(l, ty, v);
+    return true;
 }
 
-static node_t *arith2ptr(node_t * dty, node_t * l)
+// evaluate an arithmetic constant without building nodes
+static bool value_eval(node_t * expr, struct cvalue *cv)
 {
-    cc_assert(isint(AST_TYPE(l)));
-    if (!isiliteral(l))
-        return NULL;
-    // int => ptr
-    return int_literal_node(dty, SYM_VALUE(EXPR_SYM(l)));
+    switch (AST_ID(expr)) {
+    case INTEGER_LITERAL:
+    case FLOAT_LITERAL:
+        cv->type = AST_TYPE(expr);
+        cv->v = SYM_VALUE(EXPR_SYM(expr));
+        return true;
+    case REF_EXPR:
+        if (EXPR_OP(expr) != ENUM)
+            return false;
+        cv->type = AST_TYPE(expr);
+        cv->v = SYM_VALUE(EXPR_SYM(expr));
+        return true;
+    case PAREN_EXPR:
+        return value_eval(EXPR_OPERAND(expr, 0), cv);
+    case COMPOUND_LITERAL:
+        {
+            // a scalar compound literal: (int){1}
+            node_t *inits = EXPR_OPERAND(expr, 0);
+            if (!isscalar(AST_TYPE(expr)) || AST_ID(inits) != INITS_EXPR ||
+                LIST_LEN(EXPR_INITS(inits)) == 0 ||
+                AST_ID(EXPR_INITS(inits)[0]) == VINIT_EXPR)
+                return false;
+            return value_eval(EXPR_INITS(inits)[0], cv);
+        }
+    case CAST_EXPR:
+    case CONV_EXPR:
+        return value_eval(EXPR_OPERAND(expr, 0), cv) &&
+            value_cast(AST_TYPE(expr), cv);
+    case COND_EXPR:
+        if (!value_eval(EXPR_COND(expr), cv))
+            return false;
+        if (value_bool(cv))
+            return value_eval(EXPR_THEN(expr), cv);
+        else
+            return value_eval(EXPR_ELSE(expr), cv);
+    case UNARY_OPERATOR:
+        if (EXPR_OP(expr) == SIZEOF) {
+            node_t *l = EXPR_OPERAND(expr, 0);
+            node_t *ty = istype(l) ? l : AST_TYPE(l);
+            set_int(cv, AST_TYPE(expr), TYPE_SIZE(ty));
+            return true;
+        }
+        return value_eval(EXPR_OPERAND(expr, 0), cv) &&
+            value_uop(EXPR_OP(expr), AST_TYPE(expr), cv);
+    case BINARY_OPERATOR:
+        {
+            int op = EXPR_OP(expr);
+            struct cvalue r;
+
+            if (!value_eval(EXPR_OPERAND(expr, 0), cv))
+                return false;
+            if (op == AND || op == OR) {
+                if (value_bool(cv) == (op == OR)) {
+                    set_int(cv, inttype, op == OR);
+                    return true;
+                }
+                if (!value_eval(EXPR_OPERAND(expr, 1), cv))
+                    return false;
+                set_int(cv, inttype, value_bool(cv));
+                return true;
+            }
+            if (!value_eval(EXPR_OPERAND(expr, 1), &r))
+                return false;
+            if (op == ',') {
+                *cv = r;
+                return true;
+            }
+            return value_bop(op, AST_TYPE(expr), cv, &r);
+        }
+    default:
+        return false;
+    }
 }
 
-static node_t *ptr2arith(node_t * dty, node_t * l)
+static node_t *literal_node(struct cvalue *cv)
 {
-    cc_assert(isint(dty));
-    if (!isiliteral(l))
-        return NULL;
-    // ptr => int
-    return int_literal_node(dty, SYM_VALUE(EXPR_SYM(l)));
+    int id = isfloat(cv->type) ? FLOAT_LITERAL : INTEGER_LITERAL;
+    node_t *n = ast_expr(id, cv->type, NULL, NULL);
+    EXPR_SYM(n) = anonymous(constants, CONSTANT);
+    SYM_TYPE(EXPR_SYM(n)) = cv->type;
+    SYM_VALUE(EXPR_SYM(n)) = cv->v;
+    return n;
+}
+
+static bool literal_value(node_t * n, struct cvalue *cv)
+{
+    if (!isiliteral(n) && !isfliteral(n))
+        return false;
+    cv->type = AST_TYPE(n);
+    cv->v = SYM_VALUE(EXPR_SYM(n));
+    return true;
+}
+
+// fold 'expr' by value if it's arithmetic, on the tree otherwise
+static node_t *fold(node_t * expr)
+{
+    struct cvalue cv;
+
+    if (isiliteral(expr) || isfliteral(expr))
+        return expr;
+    if (value_eval(expr, &cv))
+        return literal_node(&cv);
+    return doeval(expr);
 }
 
 static node_t *ptr2ptr(node_t * dty, node_t * l)
@@ -217,16 +397,17 @@ static node_t *cast(node_t * dty, node_t * l)
         l = EXPR_INITS(l)[0];
 
     node_t *sty = AST_TYPE(l);
+    struct cvalue cv;
+    if (isarith(dty) || isptr(dty)) {
+        if (literal_value(l, &cv))
+            return value_cast(dty, &cv) ? literal_node(&cv) : NULL;
+    }
+
     if (isarith(dty)) {
-        if (isarith(sty))
-            return arith2arith(dty, l);
-        else if (isptr(sty))
-            return ptr2arith(dty, l);
+        return NULL;
     } else if (isptr(dty)) {
         if (isptr(sty))
             return ptr2ptr(dty, l);
-        else if (isarith(sty))
-            return arith2ptr(dty, l);
         else if (isfunc(sty))
             return func2ptr(dty, l);
         else if (isarray(sty))
@@ -242,17 +423,6 @@ static node_t *cast(node_t * dty, node_t * l)
     return NULL;
 }
 
-// 'expr' was evaluated and _NOT_ null.
-static bool scalar_bool(node_t * expr)
-{
-    cc_assert(isiliteral(expr) || isfliteral(expr));
-
-    if (isiliteral(expr))
-        return ILITERAL_VALUE(expr) != 0;
-    else
-        return FLITERAL_VALUE(expr) != 0;
-}
-
 // '&': 'expr' was not evaluated.
 static node_t *address_uop(node_t * expr)
 {
@@ -274,256 +444,41 @@ static node_t *address_uop(node_t * expr)
     cc_assert(0);
 }
 
-static node_t *sizeof_uop(node_t * expr)
-{
-    node_t *l = EXPR_OPERAND(expr, 0);
-    node_t *ty = istype(l) ? l : AST_TYPE(l);
-    union value val;
-    VALUE_U(val) = TYPE_SIZE(ty);
-    return int_literal_node(AST_TYPE(expr), val);
-}
-
-static node_t *scalar_uop(int op, node_t * ty, node_t * l)
-{
-    if (!isiliteral(l) && !isfliteral(l))
-        return NULL;
-
-    union value lval = SYM_VALUE(EXPR_SYM(l));
-
-    switch (op) {
-    case '!':
-        if (isiliteral(l))
-            return VALUE_U(lval) ==
-                0 ? one_literal() : zero_literal();
-        else
-            return VALUE_D(lval) ==
-                0 ? one_literal() : zero_literal();
-    default:
-        cc_assert(0);
-    }
-}
-
-static node_t *arith_uop(int op, node_t * ty, node_t * l)
-{
-    if (!isiliteral(l) && !isfliteral(l))
-        return NULL;
-
-    union value lval = SYM_VALUE(EXPR_SYM(l));
-    union value rval;
-
-    switch (op) {
-    case '+':
-        return l;
-    case '-':
-        if (isiliteral(l)) {
-            VALUE_U(rval) = -VALUE_U(lval);
-            return int_literal_node(ty, rval);
-        } else {
-            VALUE_D(rval) = -VALUE_D(lval);
-            return float_literal_node(ty, rval);
-        }
-    default:
-        cc_assert(0);
-    }
-}
-
-static node_t *int_uop(int op, node_t * ty, node_t * l)
-{
-    if (!isiliteral(l))
-        return NULL;
-
-    union value lval = SYM_VALUE(EXPR_SYM(l));
-    union value rval;
-
-    switch (op) {
-    case '~':
-        VALUE_U(rval) = ~VALUE_U(lval);
-        return int_literal_node(ty, rval);
-    default:
-        cc_assert(0);
-    }
-}
-
-static node_t *scalar_bop(int op, node_t * ty, node_t * l, node_t * r)
-{
-    if (!isiliteral(l) && !isfliteral(l))
-        return NULL;
-
-    cc_assert(TYPE_KIND(AST_TYPE(l)) == TYPE_KIND(AST_TYPE(r)));
-
-    union value lval = SYM_VALUE(EXPR_SYM(l));
-    union value rval = SYM_VALUE(EXPR_SYM(r));
-    bool is_int = AST_TYPE(l);
-
-#define SCALAR_OP(op)                                        \
-    if (is_int) {                                        \
-        bool b;                                                \
-        int sign1 = TYPE_OP(AST_TYPE(l));                \
-        int sign2 = TYPE_OP(AST_TYPE(r));                \
-        if (sign1 == UNSIGNED && sign2 == UNSIGNED) {        \
-            b = VALUE_U(lval) op VALUE_U(rval);                \
-        }  else if (sign1 == INT && sign2 == INT) {        \
-            long long l = VALUE_I(lval);                \
-            long long r = VALUE_I(rval);                \
-            b = l op r;                                        \
-        } else if (sign1 == UNSIGNED) {                        \
-            b = true;                                        \
-        } else {                                        \
-            b = false;                                        \
-        }                                                \
-        return b ? one_literal() : zero_literal();        \
-    } else {                                                \
-        bool b = VALUE_D(lval) op VALUE_D(rval);        \
-        return b ? one_literal() : zero_literal();        \
-    }
-
-    switch (op) {
-    case '<':
-        SCALAR_OP(<);
-        break;
-    case '>':
-        SCALAR_OP(>);
-        break;
-    case GEQ:
-        SCALAR_OP(>=);
-        break;
-    case LEQ:
-        SCALAR_OP(<=);
-        break;
-    case EQ:
-        SCALAR_OP( ==);
-        break;
-    case NEQ:
-        SCALAR_OP(!=);
-        break;
-    default:
-        cc_assert(0);
-    }
-}
-
 // both 'ptr' and 'i' are _NOT_ evaluated.
 static node_t *ptr_int_bop(int op, node_t * ty, node_t * ptr, node_t * i)
 {
     node_t *l = doeval(ptr);
     if (!l)
         return NULL;
-    node_t *r = doeval(i);
-    if (!r || !isiliteral(r))
+    struct cvalue r;
+    if (!value_eval(i, &r) || !isint(r.type))
         return NULL;
     // combine
     if (AST_ID(l) == BINARY_OPERATOR) {
         int op1 = EXPR_OP(l);
-        node_t *r1 = EXPR_OPERAND(l, 1);
+        struct cvalue r1;
 
         cc_assert(op1 == '+' || op1 == '-');
-        cc_assert(isiliteral(r1));
+        literal_value(EXPR_OPERAND(l, 1), &r1);
 
         node_t *n;
         if (op == op1) {
-            n = bop('+', r, r1);
+            n = bop('+', literal_node(&r), literal_node(&r1));
         } else {
-            node_t *r2 = op == '+' ? r : r1;
-            node_t *r3 = r2 == r ? r1 : r;
-            n = bop('-', r2, r3);
+            struct cvalue *r2 = op == '+' ? &r : &r1;
+            struct cvalue *r3 = r2 == &r ? &r1 : &r;
+            n = bop('-', literal_node(r2), literal_node(r3));
             op = '+';
         }
-        r = arith_bop(EXPR_OP(n), AST_TYPE(n), EXPR_OPERAND(n, 0),
-                      EXPR_OPERAND(n, 1));
+        if (!value_eval(n, &r))
+            return NULL;
         l = EXPR_OPERAND(l, 0);
     }
-    return ast_bop(op, ty, l, r);
-}
-
-static node_t *arith_bop(int op, node_t * ty, node_t * l, node_t * r)
-{
-    if (!isiliteral(l) && !isfliteral(r))
-        return NULL;
-    else if (!isiliteral(r) && !isfliteral(r))
-        return NULL;
-
-    cc_assert(TYPE_KIND(AST_TYPE(l)) == TYPE_KIND(AST_TYPE(r)));
-    cc_assert(TYPE_KIND(AST_TYPE(l)) == TYPE_KIND(ty));
-    cc_assert(TYPE_OP(AST_TYPE(l)) == TYPE_OP(AST_TYPE(r)));
-    cc_assert(TYPE_OP(AST_TYPE(l)) == TYPE_OP(ty));
-
-    union value lval = SYM_VALUE(EXPR_SYM(l));
-    union value rval = SYM_VALUE(EXPR_SYM(r));
-    bool is_int = isint(ty);
-    union value val;
-
-#define ARITH_BOP(op)                                                \
-    do {                                                        \
-        if (is_int)                                                \
-            VALUE_U(val) = VALUE_U(lval) op VALUE_U(rval);        \
-        else                                                        \
-            VALUE_D(val) = VALUE_D(lval) op VALUE_D(rval);        \
-    } while (0)
-
-    switch (op) {
-    case '+':
-        ARITH_BOP(+);
-        break;
-    case '-':
-        ARITH_BOP(-);
-        break;
-    case '*':
-        ARITH_BOP(*);
-        break;
-    case '/':
-        ARITH_BOP(/);
-        break;
-    default:
-        cc_assert(0);
-    }
-
-    if (is_int)
-        return int_literal_node(ty, val);
-    else
-        return float_literal_node(ty, val);
-}
-
-static node_t *int_bop(int op, node_t * ty, node_t * l, node_t * r)
-{
-    if (!isiliteral(l) || !isiliteral(r))
-        return NULL;
-
-    cc_assert(TYPE_KIND(AST_TYPE(l)) == TYPE_KIND(AST_TYPE(r)));
-    cc_assert(TYPE_KIND(AST_TYPE(l)) == TYPE_KIND(ty));
-    cc_assert(TYPE_OP(AST_TYPE(l)) == TYPE_OP(AST_TYPE(r)));
-    cc_assert(TYPE_OP(AST_TYPE(l)) == TYPE_OP(ty));
-
-    union value lval = SYM_VALUE(EXPR_SYM(l));
-    union value rval = SYM_VALUE(EXPR_SYM(r));
-    union value val;
-
-#define INT_BOP(op)  VALUE_U(val) = VALUE_U(lval) op VALUE_U(rval)
-
-    switch (op) {
-    case '%':
-        INT_BOP(%);
-        break;
-    case LSHIFT:
-        INT_BOP(<<);
-        break;
-    case RSHIFT:
-        INT_BOP(>>);
-        break;
-    case '|':
-        INT_BOP(|);
-        break;
-    case '&':
-        INT_BOP(&);
-        break;
-    case '^':
-        INT_BOP(^);
-        break;
-    default:
-        cc_assert(0);
-    }
-
-    return int_literal_node(ty, val);
+    return ast_bop(op, ty, l, literal_node(&r));
 }
 
+// an address constant, an initializer or an arithmetic
+// constant that didn't fold by value
 static node_t *doeval(node_t * expr)
 {
     cc_assert(isexpr(expr));
@@ -533,48 +488,16 @@ static node_t *doeval(node_t * expr)
             node_t *l = EXPR_OPERAND(expr, 0);
             node_t *r = EXPR_OPERAND(expr, 1);
             int op = EXPR_OP(expr);
-            struct bop *bop;
             switch (op) {
-            case '=':
-                return NULL;
             case ',':
                 if (doeval(l))
                     return doeval(r);
                 else
                     return NULL;
-                // int
-            case '%':
-            case '|':
-            case '&':
-            case '^':
-            case LSHIFT:
-            case RSHIFT:
-                // arith
-            case '*':
-            case '/':
-                // scalar
-            case '<':
-            case '>':
-            case GEQ:
-            case LEQ:
-            case EQ:
-            case NEQ:
-            dispatch:
-                bop = dispatch_bop(op);
-                cc_assert(bop->is(AST_TYPE(l)));
-                cc_assert(bop->is(AST_TYPE(r)));
-                l = doeval(l);
-                if (!l)
-                    return NULL;
-                r = doeval(r);
-                if (!r)
-                    return NULL;
-                return bop->eval(op, AST_TYPE(expr), l, r);
             case '+':
+                if (isarith(AST_TYPE(l)) && isarith(AST_TYPE(r)))
+                    return NULL;
                 {
-                    if (isarith(AST_TYPE(l))
-                        && isarith(AST_TYPE(r)))
-                        goto dispatch;
                     // ptr + int or int + ptr
                     node_t *ptr =
                         isptr(AST_TYPE(l)) ? l : r;
@@ -585,82 +508,48 @@ static node_t *doeval(node_t * expr)
                                        ptr, i);
                 }
             case '-':
-                if (!isptr(AST_TYPE(l)))
-                    goto dispatch;
+                if (!isptr(AST_TYPE(l)) || !isint(AST_TYPE(r)))
+                    return NULL;
                 // ptr - int
-                cc_assert(isint(AST_TYPE(r)));
                 return ptr_int_bop(op, AST_TYPE(expr), l, r);
-            case AND:
-            case OR:
-                l = doeval(l);
-                if (!l || (!isiliteral(l) && !isfliteral(l)))
-                    return NULL;
-                if (op == AND && !scalar_bool(l))
-                    return zero_literal();
-                else if (op == OR && scalar_bool(l))
-                    return one_literal();
-                return doeval(r);
             default:
-                cc_assert(0);
-            }
-        }
-        break;
-    case UNARY_OPERATOR:
-        {
-            node_t *l = EXPR_OPERAND(expr, 0);
-            int op = EXPR_OP(expr);
-            struct uop *uop;
-            switch (op) {
-            case INCR:
-            case DECR:
-            case '*':
+                // the rest only fold by value
                 return NULL;
-            case '&':
-                return address_uop(expr);
-            case '+':
-            case '-':
-            case '~':
-            case '!':
-                uop = dispatch_uop(op);
-                cc_assert(uop->is(AST_TYPE(l)));
-                l = doeval(l);
-                if (!l)
-                    return NULL;
-                return uop->eval(op, AST_TYPE(expr), l);
-            case SIZEOF:
-                return sizeof_uop(expr);
-            default:
-                cc_assert(0);
             }
         }
         break;
+    case UNARY_OPERATOR:
+        if (EXPR_OP(expr) == '&')
+            return address_uop(expr);
+        return NULL;
     case PAREN_EXPR:
     case COMPOUND_LITERAL:
         return doeval(EXPR_OPERAND(expr, 0));
     case CAST_EXPR:
     case CONV_EXPR:
-        return cast(AST_TYPE(expr), doeval(EXPR_OPERAND(expr, 0)));
+        return cast(AST_TYPE(expr), fold(EXPR_OPERAND(expr, 0)));
     case COND_EXPR:
         {
-            node_t *cond = doeval(EXPR_COND(expr));
-            if (!cond || (!isiliteral(cond) && !isfliteral(cond)))
+            struct cvalue cond;
+            if (!value_eval(EXPR_COND(expr), &cond))
                 return NULL;
-            if (scalar_bool(cond))
-                return doeval(EXPR_THEN(expr));
+            if (value_bool(&cond))
+                return fold(EXPR_THEN(expr));
             else
-                return doeval(EXPR_ELSE(expr));
+                return fold(EXPR_ELSE(expr));
         }
     case INITS_EXPR:
         {
             struct vector *v = vec_new();
             node_t **inits = EXPR_INITS(expr);
-            for (int i = 0; i < LIST_LEN(inits); i++) {
+            int len = LIST_LEN(inits);
+            for (int i = 0; i < len; i++) {
                 node_t *n = inits[i];
                 if (AST_ID(n) == VINIT_EXPR) {
                     vec_push(v, n);
                     continue;
                 }
-                n = doeval(n);
+                n = fold(n);
                 if (!n) {
                     vec_free(v);
                     return NULL;
@@ -683,12 +572,13 @@ static node_t *doeval(node_t * expr)
             cc_assert(isptr(AST_TYPE(ptr)));
             cc_assert(isint(AST_TYPE(i)));
             node_t *p = ptr_int_bop('+', AST_TYPE(ptr), ptr, i);
+            if (!p)
+                return NULL;
             return ast_uop('*', AST_TYPE(expr), p);
         }
     case REF_EXPR:
         if (EXPR_OP(expr) == ENUM)
-            return int_literal_node(AST_TYPE(expr),
-                                    SYM_VALUE(EXPR_SYM(expr)));
+            return fold(expr);
         else
             return expr;
     case INTEGER_LITERAL:
@@ -709,11 +599,11 @@ node_t *eval(node_t * expr, node_t * ty)
     if (!expr)
         return NULL;
 
+    struct cvalue cv;
+    if (value_eval(expr, &cv)) {
+        if (isarith(ty) || isptr(ty))
+            return value_cast(ty, &cv) ? literal_node(&cv) : NULL;
+        return cast(ty, literal_node(&cv));
+    }
     return cast(ty, doeval(expr));
 }
-
-bool eval_cpp_cond(void)
-{
-    gettok();
-    return intexpr();
-}
@@ -451,7 +451,11 @@ static unsigned escape(const char **ps)
     return c;
 }
 
-static void char_constant(struct token *t, node_t * sym)
+/**
+ * Value of a character constant, also used by
+ * the preprocessor when evaluating #if.
+ */
+unsigned long long char_value(struct token *t)
 {
     const char *s = t->name;
     bool wide = s[0] == 'L';
@@ -471,7 +475,7 @@ static void char_constant(struct token *t, node_t * sym)
         } else {
             if (wide) {
                 if (len >= MB_LEN_MAX)
-                    error("multibyte character overflow");
+                    errorf(t->src, "multibyte character overflow");
                 else
                     ws[len++] = (char)*s++;
             } else {
@@ -482,17 +486,23 @@ static void char_constant(struct token *t, node_t * sym)
     }
 
     if (!char_rec && !len)
-        error("incomplete character constant: %s", t->name);
+        errorf(t->src, "incomplete character constant: %s", t->name);
     else if (overflow)
-        error("extraneous characters in character constant: %s",
-              t->name);
+        errorf(t->src, "extraneous characters in character constant: %s",
+               t->name);
     else if ((!wide && c > UINTEGER_MAX(unsignedchartype))
              || (wide && c > UINTEGER_MAX(wchartype)))
-        error("character constant overflow: %s", t->name);
+        errorf(t->src, "character constant overflow: %s", t->name);
     else if (len && mbtowc((wchar_t *) & c, ws, len) != len)
-        error("illegal multi-character sequence");
+        errorf(t->src, "illegal multi-character sequence");
 
-    SYM_VALUE_U(sym) = wide ? (wchar_t) c : (unsigned char)c;
+    return wide ? (wchar_t) c : (unsigned char)c;
+}
+
+static void char_constant(struct token *t, node_t * sym)
+{
+    bool wide = t->name[0] == 'L';
+    SYM_VALUE_U(sym) = char_value(t);
     SYM_TYPE(sym) = wide ? wchartype : unsignedchartype;
 }
 
@@ -853,7 +863,7 @@ static node_t *number_literal(struct token *t)
 {
     node_t *sym = lookup(t->name, constants);
     if (!sym) {
-        sym = install(t->name, &constants, CONSTANT);
+        sym = install(t->name, constants, CONSTANT);
         number_constant(t, sym);
     }
     int id = isint(SYM_TYPE(sym)) ? INTEGER_LITERAL : FLOAT_LITERAL;
@@ -867,7 +877,7 @@ static node_t *string_literal(struct token *t)
 {
     node_t *sym = lookup(t->name, constants);
     if (!sym) {
-        sym = install(t->name, &constants, CONSTANT);
+        sym = install(t->name, constants, CONSTANT);
         string_constant(t, sym);
     }
     node_t *expr = ast_expr(STRING_LITERAL, SYM_TYPE(sym), NULL, NULL);
@@ -887,7 +897,7 @@ node_t *new_integer_literal(int i)
 node_t *new_string_literal(const char *string)
 {
     struct token *t = new_token(&(struct token){.id = SCONSTANT,.name =
-                format("\"%s\"", string) });
+                strs(format("\"%s\"", string)) });
     node_t *expr = string_literal(t);
     return expr;
 }
@@ -1192,7 +1202,9 @@ static node_t *direction(node_t * node)
             ty = rtype(ty);
     }
     if (isrecord(ty)) {
-        field = find_field(ty, name);
+        // a definition hidden by its generation has no fields yet
+        if (!isincomplete(ty))
+            field = find_field(ty, name);
         if (field == NULL)
             field_not_found_error(ty, name);
     }
@@ -1515,160 +1527,52 @@ static node_t *cast_expr(void)
     return unary_expr();
 }
 
-static node_t *multiple_expr(void)
-{
-    node_t *mulp1;
-
-    mulp1 = cast_expr();
-    while (token->id == '*' || token->id == '/' || token->id == '%') {
-        int t = token->id;
-        SAVE_SOURCE;
-        expect(t);
-        mulp1 = bop(t, conv(mulp1), conv(cast_expr()));
-        SET_SOURCE(mulp1);
-    }
-
-    return mulp1;
-}
-
-static node_t *additive_expr(void)
-{
-    node_t *add1;
-
-    add1 = multiple_expr();
-    while (token->id == '+' || token->id == '-') {
-        int t = token->id;
-        SAVE_SOURCE;
-        expect(t);
-        add1 = bop(t, conv(add1), conv(multiple_expr()));
-        SET_SOURCE(add1);
-    }
-
-    return add1;
-}
-
-static node_t *shift_expr(void)
-{
-    node_t *shift1;
-
-    shift1 = additive_expr();
-    while (token->id == LSHIFT || token->id == RSHIFT) {
-        int t = token->id;
-        SAVE_SOURCE;
-        expect(t);
-        shift1 = bop(t, conv(shift1), conv(additive_expr()));
-        SET_SOURCE(shift1);
-    }
-
-    return shift1;
-}
-
-static node_t *relation_expr(void)
-{
-    node_t *rel;
-
-    rel = shift_expr();
-    while (token->id == '<' || token->id == '>' || token->id == LEQ
-           || token->id == GEQ) {
-        int t = token->id;
-        SAVE_SOURCE;
-        expect(t);
-        rel = bop(t, conv(rel), conv(shift_expr()));
-        SET_SOURCE(rel);
-    }
-
-    return rel;
-}
-
-static node_t *equality_expr(void)
-{
-    node_t *equl;
-
-    equl = relation_expr();
-    while (token->id == EQ || token->id == NEQ) {
-        int t = token->id;
-        SAVE_SOURCE;
-        expect(t);
-        equl = bop(t, conv(equl), conv(relation_expr()));
-        SET_SOURCE(equl);
-    }
-
-    return equl;
-}
-
-static node_t *and_expr(void)
-{
-    node_t *and1;
-
-    and1 = equality_expr();
-    while (token->id == '&') {
-        SAVE_SOURCE;
-        expect('&');
-        and1 = bop('&', conv(and1), conv(equality_expr()));
-        SET_SOURCE(and1);
-    }
-
-    return and1;
-}
-
-static node_t *exclusive_or(void)
-{
-    node_t *eor;
-
-    eor = and_expr();
-    while (token->id == '^') {
-        SAVE_SOURCE;
-        expect('^');
-        eor = bop('^', conv(eor), conv(and_expr()));
-        SET_SOURCE(eor);
-    }
-
-    return eor;
-}
-
-static node_t *inclusive_or(void)
-{
-    node_t *ior;
-
-    ior = exclusive_or();
-    while (token->id == '|') {
-        SAVE_SOURCE;
-        expect('|');
-        ior = bop('|', conv(ior), conv(exclusive_or()));
-        SET_SOURCE(ior);
-    }
-
-    return ior;
-}
-
-static node_t *logic_and(void)
-{
-    node_t *and1;
-
-    and1 = inclusive_or();
-    while (token->id == AND) {
-        SAVE_SOURCE;
-        expect(AND);
-        and1 = logicop(AND, conv(and1), conv(inclusive_or()));
-        SET_SOURCE(and1);
+/* Binary operators
+ *
+ * Parsed by precedence climbing: binary_expr(k) parses
+ * the operators of precedence k and higher, so an operand
+ * costs one call instead of one per precedence level. All
+ * binary operators are left associative.
+ */
+static const unsigned char precs[TOKEND] = {
+    [OR] = 1,
+    [AND] = 2,
+    ['|'] = 3,
+    ['^'] = 4,
+    ['&'] = 5,
+    [EQ] = 6, [NEQ] = 6,
+    ['<'] = 7, ['>'] = 7, [LEQ] = 7, [GEQ] = 7,
+    [LSHIFT] = 8, [RSHIFT] = 8,
+    ['+'] = 9, ['-'] = 9,
+    ['*'] = 10, ['/'] = 10, ['%'] = 10,
+};
+
+#define PREC(t)    ((unsigned)(t) < TOKEND ? precs[t] : 0)
+
+static node_t *binary_expr(int k)
+{
+    node_t *l = cast_expr();
+
+    for (int k1 = PREC(token->id); k1 >= k; k1--) {
+        while (PREC(token->id) == k1) {
+            int t = token->id;
+            SAVE_SOURCE;
+            expect(t);
+            node_t *r = binary_expr(k1 + 1);
+            if (t == AND || t == OR)
+                l = logicop(t, conv(l), conv(r));
+            else
+                l = bop(t, conv(l), conv(r));
+            SET_SOURCE(l);
+        }
     }
 
-    return and1;
+    return l;
 }
 
 static node_t *logic_or(void)
 {
-    node_t *or1;
-
-    or1 = logic_and();
-    while (token->id == OR) {
-        SAVE_SOURCE;
-        expect(OR);
-        or1 = logicop(OR, conv(or1), conv(logic_and()));
-        SET_SOURCE(or1);
-    }
-
-    return or1;
+    return binary_expr(1);
 }
 
 static node_t *cond_expr1(node_t * cond)
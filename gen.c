@@ -20,7 +20,7 @@
  *  cs,ds,es,fs,gs,ss
  */
 
-static FILE *outfp;
+static THREAD_LOCAL FILE *outfp;
 
 #define NUM_IARG_REGS  6
 #define NUM_FARG_REGS  8
@@ -39,10 +39,10 @@ enum {
     FLOAT_REGS
 };
 
-static struct reg *iarg_regs[NUM_IARG_REGS];
-static struct reg *farg_regs[NUM_FARG_REGS];
-static struct reg *int_regs[INT_REGS];
-static struct reg *float_regs[FLOAT_REGS];
+static THREAD_LOCAL struct reg *iarg_regs[NUM_IARG_REGS];
+static THREAD_LOCAL struct reg *farg_regs[NUM_FARG_REGS];
+static THREAD_LOCAL struct reg *int_regs[INT_REGS];
+static THREAD_LOCAL struct reg *float_regs[FLOAT_REGS];
 static struct reg * rsp = &(struct reg){
     .r[Q] = "%rsp",
     .r[L] = "%esp",
@@ -86,7 +86,7 @@ static void emit_noindent(const char *fmt, ...)
 
 static struct addr * make_addr_with_type(int kind)
 {
-    struct addr *addr = zmalloc(sizeof(struct addr));
+    struct addr *addr = ralloc(REGION_FUNC, sizeof(struct addr));
     addr->kind = kind;
     return addr;
 }
@@ -788,6 +788,7 @@ static void emit_function_epilogue(struct gdata *gdata)
 static void emit_text(struct gdata *gdata)
 {
     node_t *decl = gdata->u.decl;
+    struct region *saved = set_region(REGION_FUNC, gdata->region);
     
     emit_function_prologue(gdata);
     emit_function_params(decl);
@@ -795,6 +796,12 @@ static void emit_text(struct gdata *gdata)
     init_text(decl);
     emit_tacs(DECL_X_HEAD(decl));
     emit_function_epilogue(gdata);
+
+    // the IR and the addresses of the function are dead
+    set_region(REGION_FUNC, saved);
+    free_region(gdata->region);
+    gdata->region = NULL;
+    DECL_X_HEAD(decl) = NULL;
 }
 
 static void emit_data(struct gdata *gdata)
@@ -841,24 +848,19 @@ static void emit_bss(struct gdata *gdata)
 
 static void emit_compounds(struct dict *compounds)
 {
-    struct vector *keys = compounds->keys;
-    if (vec_len(keys)) {
-        for (int i = 0; i < vec_len(keys); i++) {
-            const char *label = vec_at(compounds->keys, i);
-            struct gdata *gdata = dict_get(compounds, label);
-            emit_data(gdata);
-        }
+    for (int i = 0; i < dict_len(compounds); i++) {
+        struct gdata *gdata = dict_value(compounds, i);
+        emit_data(gdata);
     }
 }
 
 static void emit_strings(struct dict *strings)
 {
-    struct vector *keys = strings->keys;
-    if (vec_len(keys)) {
+    if (dict_len(strings)) {
         emit(".section .rodata");
-        for (int i = 0; i < vec_len(keys); i++) {
-            const char *name = vec_at(strings->keys, i);
-            const char *label = dict_get(strings, name);
+        for (int i = 0; i < dict_len(strings); i++) {
+            const char *name = dict_key(strings, i);
+            const char *label = dict_value(strings, i);
             emit_noindent("%s:", label);
             emit(".asciz %s", name);
         }
@@ -867,12 +869,11 @@ static void emit_strings(struct dict *strings)
 
 static void emit_floats(struct dict *floats)
 {
-    struct vector *keys = floats->keys;
-    if (vec_len(keys)) {
+    if (dict_len(floats)) {
         emit(".section .rodata");
-        for (int i = 0; i < vec_len(keys); i++) {
-            const char *name = vec_at(floats->keys, i);
-            const char *label = dict_get(floats, name);
+        for (int i = 0; i < dict_len(floats); i++) {
+            const char *name = dict_key(floats, i);
+            const char *label = dict_value(floats, i);
             node_t *sym = lookup(name, constants);
             cc_assert(sym);
             node_t *ty = SYM_TYPE(sym);
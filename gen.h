@@ -52,6 +52,7 @@ struct gdata {
         // decl
         node_t *decl;
     } u;
+    struct region *region;        // IR of the function
 };
 
 enum {
@@ -96,6 +97,7 @@ struct tac {
     unsigned opsize:6;
     unsigned from_opsize:6;
     unsigned to_opsize:6;
+    unsigned sign:1;            // relop compares signed integers
     int relop;
     struct operand *args[2];
     struct operand *result;
@@ -110,61 +112,70 @@ struct externals {
     struct dict *floats;
 };
 
+/* Backend data of the AST nodes.
+ *
+ * It is kept out of the nodes in records allocated on the
+ * first access, so that the front end doesn't pay for it.
+ */
+struct sym_x {
+    const char *label;
+    long loff;                  // local offset (<0)
+    // kind
+    int kind;
+    // uses
+    struct uses uses;
+    // addrs
+    struct addr *addrs[ADDRS];
+};
+
+struct decl_x {
+    node_t **lvars;             // function local vars
+    node_t **svars;             // function static vars
+    node_t **calls;             // function calls
+    struct tac *head;
+};
+
+struct expr_x {
+    struct operand *addr;
+    struct operand *array;
+
+    // label
+    long btrue;
+    long bfalse;
+};
+
+struct stmt_x {
+    long label;
+
+    // label
+    long next;
+};
+
 // sym
-#define SYM_X_LABEL(NODE)     ((NODE)->symbol.x.sym.label)
-#define SYM_X_USES(NODE)      ((NODE)->symbol.x.sym.uses)
-#define SYM_X_ADDRS(NODE)     ((NODE)->symbol.x.sym.addrs)
-#define SYM_X_KIND(NODE)      ((NODE)->symbol.x.sym.kind)
-#define SYM_X_LOFF(NODE)      ((NODE)->symbol.x.sym.loff)
+#define SYM_X_LABEL(NODE)     (sym_x(NODE)->label)
+#define SYM_X_USES(NODE)      (sym_x(NODE)->uses)
+#define SYM_X_ADDRS(NODE)     (sym_x(NODE)->addrs)
+#define SYM_X_KIND(NODE)      (sym_x(NODE)->kind)
+#define SYM_X_LOFF(NODE)      (sym_x(NODE)->loff)
 // decl
-#define DECL_X_SVARS(NODE)    ((NODE)->decl.x.decl.svars)
-#define DECL_X_LVARS(NODE)    ((NODE)->decl.x.decl.lvars)
-#define DECL_X_CALLS(NODE)    ((NODE)->decl.x.decl.calls)
-#define DECL_X_HEAD(NODE)     ((NODE)->decl.x.decl.head)
+#define DECL_X_SVARS(NODE)    (decl_x(NODE)->svars)
+#define DECL_X_LVARS(NODE)    (decl_x(NODE)->lvars)
+#define DECL_X_CALLS(NODE)    (decl_x(NODE)->calls)
+#define DECL_X_HEAD(NODE)     (decl_x(NODE)->head)
 // expr
-#define EXPR_X_ADDR(NODE)     ((NODE)->expr.x.expr.addr)
-#define EXPR_X_TRUE(NODE)     ((NODE)->expr.x.expr.btrue)
-#define EXPR_X_FALSE(NODE)    ((NODE)->expr.x.expr.bfalse)
-#define EXPR_X_ARRAY(NODE)    ((NODE)->expr.x.expr.array)
+#define EXPR_X_ADDR(NODE)     (expr_x(NODE)->addr)
+#define EXPR_X_TRUE(NODE)     (expr_x(NODE)->btrue)
+#define EXPR_X_FALSE(NODE)    (expr_x(NODE)->bfalse)
+#define EXPR_X_ARRAY(NODE)    (expr_x(NODE)->array)
 // stmt
-#define STMT_X_LABEL(NODE)    ((NODE)->stmt.x.stmt.label)
-#define STMT_X_NEXT(NODE)     ((NODE)->stmt.x.stmt.next)
-
-union x {
-    struct {
-        const char *label;
-        long loff;              // local offset (<0)
-        // kind
-        int kind;
-        // uses
-        struct uses uses;
-        // addrs
-        struct addr *addrs[ADDRS];
-    }sym;
-    
-    struct {
-        node_t **lvars;        // function local vars
-        node_t **svars;        // function static vars
-        node_t **calls;        // function calls
-        struct tac *head;
-    }decl;
-    
-    struct {
-        struct operand *addr;
-        struct operand *array;
-
-        // label
-        const char *btrue;
-        const char *bfalse;
-    }expr;
-
-    struct {
-        const char *label;
-
-        // label
-        const char *next;
-    }stmt;
-};
+#define STMT_X_LABEL(NODE)    (stmt_x(NODE)->label)
+#define STMT_X_NEXT(NODE)     (stmt_x(NODE)->next)
+
+// ast.c
+extern struct sym_x *sym_x(node_t *sym);
+extern struct decl_x *decl_x(node_t *decl);
+extern struct expr_x *expr_x(node_t *expr);
+extern struct stmt_x *stmt_x(node_t *stmt);
 
 // gen.c
 extern void gen(struct externals *externals, FILE * fp);
@@ -172,6 +183,5 @@ extern void gen(struct externals *externals, FILE * fp);
 // ir.c
 extern const char *rop2s(int op);
 extern struct externals * ir(node_t *tree);
-extern node_t * reduce(node_t *expr);
 
 #endif
@@ -1,10 +1,22 @@
 #include "cc.h"
 
-static void struct_init(node_t * ty, bool brace, struct vector *v);
-static void array_init(node_t * ty, bool brace, struct vector *v);
-static void scalar_init(node_t * ty, struct vector *v);
+/* The elements of an initializer list being parsed. The holes
+ * an array designator leaves are kept as one run, so a sparse
+ * '[1 << 25] = 1' costs two nodes. Struct lists are indexed by
+ * field and hold single holes only.
+ */
+struct elems {
+    struct vector *v;
+    int len;                    // elements, a run counts its holes
+    int pos, first;             // cursor: v[pos] is element 'first'
+    bool runs;
+};
+
+static void struct_init(node_t * ty, bool brace, struct elems *e);
+static void array_init(node_t * ty, bool brace, struct elems *e);
+static void scalar_init(node_t * ty, struct elems *e);
 static void elem_init(node_t * sty, node_t * ty, bool designated,
-                      struct vector *v, int i);
+                      struct elems *e, int i);
 static node_t *initializer(node_t * ty);
 
 #define INIT_OVERRIDE    "initializer overrides prior initialization"
@@ -53,11 +65,87 @@ static bool is_string(node_t * ty)
     return TYPE_KIND(rty) == CHAR || unqual(rty) == wchartype;
 }
 
-static node_t *find_elem(struct vector *v, int i)
+static void init_elems(struct elems *e, node_t * ty)
 {
-    for (int j = vec_len(v); j <= i; j++)
-        vec_push(v, ast_vinit());
-    return vec_at(v, i);
+    e->v = vec_new();
+    e->len = e->pos = e->first = 0;
+    e->runs = ty && isarray(ty);
+}
+
+static inline int elem_len(node_t * n)
+{
+    return AST_ID(n) == VINIT_EXPR ? EXPR_VINIT_LEN(n) : 1;
+}
+
+static void add_elems(struct elems *e, node_t ** inits)
+{
+    for (int i = 0; inits && inits[i]; i++) {
+        vec_push(e->v, inits[i]);
+        e->len += elem_len(inits[i]);
+    }
+    e->pos = e->first = 0;
+}
+
+static void clear_elems(struct elems *e)
+{
+    vec_clear(e->v);
+    e->len = e->pos = e->first = 0;
+}
+
+// the position of element 'i' in the vector, a run of holes
+// it falls in is split around it
+static int elem_pos(struct elems *e, int i)
+{
+    struct vector *v = e->v;
+    int pos = e->pos;
+    int first = e->first;
+
+    if (i >= e->len) {
+        int gap = i - e->len;
+        if (gap && e->runs)
+            vec_push(v, ast_vinit(gap));
+        else
+            for (int j = 0; j < gap; j++)
+                vec_push(v, ast_vinit(1));
+        vec_push(v, ast_vinit(1));
+        e->len = i + 1;
+        pos = vec_len(v) - 1;
+    } else {
+        // designators are mostly in order, so walk from the cursor
+        while (i < first)
+            first -= elem_len(vec_at(v, --pos));
+        while (i >= first + elem_len(vec_at(v, pos)))
+            first += elem_len(vec_at(v, pos++));
+
+        node_t *n = vec_at(v, pos);
+        int after = first + elem_len(n) - i - 1;
+        if (elem_len(n) > 1) {
+            vec_set(v, pos, ast_vinit(1));
+            if (after)
+                vec_insert(v, pos + 1, ast_vinit(after));
+            if (i > first)
+                vec_insert(v, pos++, ast_vinit(i - first));
+        }
+    }
+    e->pos = pos;
+    e->first = i;
+    return pos;
+}
+
+static node_t *find_elem(struct elems *e, int i)
+{
+    return vec_at(e->v, elem_pos(e, i));
+}
+
+static void set_elem(struct elems *e, int i, node_t * node)
+{
+    vec_set(e->v, elem_pos(e, i), node);
+}
+
+static void set_elem_safe(struct elems *e, int i, node_t * node)
+{
+    if (node)
+        set_elem(e, i, node);
 }
 
 static node_t *init_elem_conv(node_t * ty, node_t * node)
@@ -89,23 +177,23 @@ void init_string(node_t * ty, node_t * node)
     }
 }
 
-static void aggregate_set(node_t * ty, struct vector *v, int i, node_t * node)
+static void aggregate_set(node_t * ty, struct elems *e, int i, node_t * node)
 {
     if (!node)
         return;
 
-    node_t *n = find_elem(v, i);
+    node_t *n = find_elem(e, i);
     if (AST_ID(n) != VINIT_EXPR)
         warningf(AST_SRC(node), INIT_OVERRIDE);
 
     if (AST_ID(node) == INITS_EXPR) {
-        vec_set(v, i, node);
+        set_elem(e, i, node);
     } else if (is_string(ty) && issliteral(node)) {
         init_string(ty, node);
-        vec_set(v, i, node);
+        set_elem(e, i, node);
     } else if (isrecord(ty) && isrecord(AST_TYPE(node))
                && eqtype(unqual(ty), unqual(AST_TYPE(node)))) {
-        vec_set(v, i, node);
+        set_elem(e, i, node);
     } else {
         node_t *rty = NULL;
         if (isarray(ty)) {
@@ -117,25 +205,26 @@ static void aggregate_set(node_t * ty, struct vector *v, int i, node_t * node)
 
         if (rty) {
             node_t *n1 = ast_inits(ty, source);
-            struct vector *v1 = vec_new();
-            vec_set(v, i, n1);
+            struct elems e1;
+            init_elems(&e1, ty);
+            set_elem(e, i, n1);
 
             if (isarray(rty) || isstruct(rty) || isunion(rty))
-                aggregate_set(rty, v1, 0, node);
+                aggregate_set(rty, &e1, 0, node);
             else
-                vec_push_safe(v1, init_elem_conv(rty, node));
+                set_elem_safe(&e1, 0, init_elem_conv(rty, node));
 
-            EXPR_INITS(n1) = (node_t **) vtoa(v1);
+            EXPR_INITS(n1) = (node_t **) vtoa(e1.v);
         }
     }
 }
 
-static void scalar_set(node_t * ty, struct vector *v, int i, node_t * node)
+static void scalar_set(node_t * ty, struct elems *e, int i, node_t * node)
 {
     if (!node)
         return;
 
-    node_t *n = find_elem(v, i);
+    node_t *n = find_elem(e, i);
     if (AST_ID(n) != VINIT_EXPR)
         warningf(AST_SRC(node), INIT_OVERRIDE);
 
@@ -147,14 +236,14 @@ static void scalar_set(node_t * ty, struct vector *v, int i, node_t * node)
             node = inits[0];
             if (AST_ID(node) == INITS_EXPR)
                 goto loop;
-            vec_set_safe(v, i, init_elem_conv(ty, node));
+            set_elem_safe(e, i, init_elem_conv(ty, node));
         }
     } else {
-        vec_set_safe(v, i, init_elem_conv(ty, node));
+        set_elem_safe(e, i, init_elem_conv(ty, node));
     }
 }
 
-static void struct_init(node_t * ty, bool brace, struct vector *v)
+static void struct_init(node_t * ty, bool brace, struct elems *e)
 {
     bool designated = false;
     int len = LIST_LEN(TYPE_FIELDS(ty));
@@ -185,7 +274,7 @@ static void struct_init(node_t * ty, bool brace, struct vector *v)
 
         if (!designated)
             fieldty = FIELD_TYPE(TYPE_FIELDS(ty)[i]);
-        elem_init(ty, fieldty, designated, v, i);
+        elem_init(ty, fieldty, designated, e, i);
         designated = false;
 
         struct token *ahead = lookahead();
@@ -198,7 +287,7 @@ static void struct_init(node_t * ty, bool brace, struct vector *v)
     }
 }
 
-static void array_init(node_t * ty, bool brace, struct vector *v)
+static void array_init(node_t * ty, bool brace, struct elems *e)
 {
     bool designated = false;
     int c = 0;
@@ -206,11 +295,11 @@ static void array_init(node_t * ty, bool brace, struct vector *v)
 
     if (is_string(ty) && token->id == SCONSTANT) {
         node_t *expr = assign_expr();
-        if (vec_len(v)) {
+        if (e->len) {
             warningf(AST_SRC(expr), INIT_OVERRIDE);
-            vec_clear(v);
+            clear_elems(e);
         }
-        aggregate_set(ty, v, 0, expr);
+        aggregate_set(ty, e, 0, expr);
         return;
     }
 
@@ -234,7 +323,7 @@ static void array_init(node_t * ty, bool brace, struct vector *v)
                  i, len);
         else
             rty = rtype(ty);
-        elem_init(ty, rty, designated, v, i);
+        elem_init(ty, rty, designated, e, i);
         designated = false;
 
         struct token *ahead = lookahead();
@@ -252,30 +341,30 @@ static void array_init(node_t * ty, bool brace, struct vector *v)
     }
 }
 
-static void scalar_init(node_t * ty, struct vector *v)
+static void scalar_init(node_t * ty, struct elems *e)
 {
     if (token->id == '.' || token->id == '[') {
         error("designator in initializer for scalar type '%s'",
               type2s(ty));
         eat_initializer();
     } else if (token->id == '{') {
-        static int braces;
+        static THREAD_LOCAL int braces;
         if (braces++ == 0)
             warning("too many braces around scalar initializer");
-        scalar_set(ty, v, 0, initializer_list(ty));
+        scalar_set(ty, e, 0, initializer_list(ty));
         braces--;
     } else {
-        scalar_set(ty, v, 0, initializer(ty));
+        scalar_set(ty, e, 0, initializer(ty));
     }
 }
 
-static inline bool is_string_vec(node_t *ty, struct vector *v)
+static inline bool is_string_vec(node_t *ty, struct elems *e)
 {
-    return is_string(ty) && vec_len(v) == 1 && issliteral((node_t *)vec_head(v));
+    return is_string(ty) && e->len == 1 && issliteral((node_t *)vec_head(e->v));
 }
 
 static void elem_init(node_t * sty, node_t * ty, bool designated,
-                      struct vector *v, int i)
+                      struct elems *e, int i)
 {
     if (isunion(sty))
         i = 0;                // always set the first elem
@@ -293,13 +382,13 @@ static void elem_init(node_t * sty, node_t * ty, bool designated,
             if (!designated)
                 error("expect designator before '='");
             expect('=');
-            aggregate_set(ty, v, i, initializer(ty));
+            aggregate_set(ty, e, i, initializer(ty));
         } else if (token->id == '{') {
             if (designated)
                 error
                     ("expect '=' or another designator at '%s'",
                      token->name);
-            aggregate_set(ty, v, i, initializer_list(ty));
+            aggregate_set(ty, e, i, initializer_list(ty));
         } else if ((token->id == '.' && isarray(ty)) ||
                    (token->id == '[' && !isarray(ty))) {
             SAVE_ERRORS;
@@ -310,38 +399,39 @@ static void elem_init(node_t * sty, node_t * ty, bool designated,
                     ("%s designator cannot initialize non-%s type '%s'",
                      TYPE_NAME(ty), TYPE_NAME(ty), type2s(ty));
         } else {
-            node_t *n = find_elem(v, i);
-            struct vector *v1 = vec_new();
+            node_t *n = find_elem(e, i);
+            struct elems e1;
+            init_elems(&e1, ty);
             if (AST_ID(n) == INITS_EXPR) {
-                vec_add_array(v1, (void **)EXPR_INITS(n));
+                add_elems(&e1, EXPR_INITS(n));
             } else if (AST_ID(n) == STRING_LITERAL) {
-                vec_push(v1, n);
+                set_elem(&e1, 0, n);
             }
 
             if (isarray(ty))
-                array_init(ty, false, v1);
+                array_init(ty, false, &e1);
             else
-                struct_init(ty, false, v1);
+                struct_init(ty, false, &e1);
 
-            if (is_string_vec(ty, v1)) {
+            if (is_string_vec(ty, &e1)) {
                 // string literal
-                vec_set(v, i, (node_t *) vec_head(v1));
+                set_elem(e, i, (node_t *) vec_head(e1.v));
             } else {
                 if (AST_ID(n) != INITS_EXPR) {
                     n = ast_inits(ty, source);
-                    vec_set(v, i, n);
+                    set_elem(e, i, n);
                 }
-                EXPR_INITS(n) = (node_t **) vtoa(v1);
+                EXPR_INITS(n) = (node_t **) vtoa(e1.v);
             }
         }
     } else {
         if (designated)
             expect('=');
-        if (is_string_vec(sty, v)) {
+        if (is_string_vec(sty, e)) {
             warning(INIT_OVERRIDE);
-            vec_clear(v);
+            clear_elems(e);
         }
-        scalar_set(ty, v, i, initializer(ty));
+        scalar_set(ty, e, i, initializer(ty));
     }
 }
 
@@ -361,17 +451,18 @@ node_t *initializer_list(node_t * ty)
 {
     int follow[] = { ',', IF, '[', ID, '.', DEREF, 0 };
     node_t *ret = ast_inits(ty, source);
-    struct vector *v = vec_new();
+    struct elems e;
 
+    init_elems(&e, ty);
     expect('{');
     if (first_init(token)) {
         if (ty) {
             if (isstruct(ty) || isunion(ty))
-                struct_init(ty, true, v);
+                struct_init(ty, true, &e);
             else if (isarray(ty))
-                array_init(ty, true, v);
+                array_init(ty, true, &e);
             else
-                scalar_init(ty, v);
+                scalar_init(ty, &e);
 
             if (token->id == ',')
                 expect(',');
@@ -392,7 +483,7 @@ node_t *initializer_list(node_t * ty)
     }
 
     match('}', follow);
-    EXPR_INITS(ret) = (node_t **) vtoa(v);
+    EXPR_INITS(ret) = (node_t **) vtoa(e.v);
     return ret;
 }
 
@@ -3,11 +3,12 @@
 #define LBUFSIZE     32
 #define RBUFSIZE     4096
 
-static struct vector *files;
+static THREAD_LOCAL struct vector *files;
 
 enum {
     FILE_KIND_REGULAR = 1,
     FILE_KIND_STRING,
+    FILE_KIND_TOKENS,
 };
 
 #define NHISTS    (FIELD_SIZEOF(struct file, hists) / sizeof(struct cc_char))
@@ -198,6 +199,225 @@ int readc(void)
     }
 }
 
+/* Raw conditional group skipping
+ *
+ * The bytes of an excluded group are scanned directly from the
+ * file buffer instead of going through readc/dolex. Only lines
+ * whose first non-blank character is '#' are looked at, all the
+ * others are skipped with memchr. Comments and string literals
+ * are still tracked so that a '#' or a newline inside them is
+ * not taken as a directive.
+ */
+
+enum {
+    RAW_CODE,
+    RAW_BLOCK_COMMENT,
+    RAW_LINE_COMMENT,
+    RAW_SEQUENCE,
+};
+
+static inline bool israwblank(int c)
+{
+    return c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r';
+}
+
+// get a raw character with line splicing
+static int rawc(struct file *fs)
+{
+    for (;;) {
+        int c = get();
+        if (c == '\\' && fs->pc[0] == '\n') {
+            get();
+            continue;
+        }
+        return c;
+    }
+}
+
+// peek the next raw character with line splicing
+static int rawpeek(struct file *fs)
+{
+    if (fs->pe - fs->pc < LBUFSIZE)
+        fillbuf(fs);
+    char *p = fs->pc;
+    while (p + 1 < fs->pe && p[0] == '\\' && p[1] == '\n')
+        p += 2;
+    return p < fs->pe ? (unsigned char)*p : EOI;
+}
+
+static bool rawnext(struct file *fs, int c)
+{
+    if (rawpeek(fs) != c)
+        return false;
+    rawc(fs);
+    return true;
+}
+
+// skip blanks and comments between '#' and the directive name
+static bool skip_rawblanks(struct file *fs)
+{
+    for (;;) {
+        int c = rawpeek(fs);
+        if (israwblank(c)) {
+            rawc(fs);
+        } else if (c == '/') {
+            rawc(fs);
+            if (rawnext(fs, '/')) {
+                // null directive with a line comment
+                while (rawpeek(fs) != '\n' && rawpeek(fs) != EOI)
+                    rawc(fs);
+                return false;
+            } else if (!rawnext(fs, '*')) {
+                return false;
+            }
+            for (;;) {
+                c = rawc(fs);
+                if (c == EOI)
+                    return false;
+                if (c == '*' && rawnext(fs, '/'))
+                    break;
+            }
+        } else {
+            return true;
+        }
+    }
+}
+
+static const char *rawname(struct file *fs)
+{
+    char buf[8];
+    size_t len = 0;
+    bool overflow = false;
+    for (;;) {
+        int c = rawpeek(fs);
+        if (!isalnum(c) && c != '_')
+            break;
+        rawc(fs);
+        if (len < ARRAY_SIZE(buf))
+            buf[len++] = c;
+        else
+            overflow = true;
+    }
+    if (len == 0 || overflow)
+        return NULL;
+    return strn(buf, len);
+}
+
+/**
+ * Skip the rest of an excluded conditional group.
+ *
+ * Return the name of the directive which terminates the group
+ * ('elif', 'else' or 'endif'), positioned right after the name,
+ * or NULL at the end of input. The '#' source is stored into 'src'
+ * and the number of lines skipped is added to 'lines'.
+ */
+const char *skip_rawgroup(struct source *src, unsigned *lines)
+{
+    struct file *fs = current_file();
+    const char *found = NULL;
+    int state = RAW_CODE;
+    int sep = 0;
+    int nest = 0;
+    bool bol = true;
+    unsigned line = fs->line;
+
+    for (;;) {
+        if (state == RAW_CODE && bol) {
+            // fast path: skip the whole line if nothing interesting
+            if (fs->pe - fs->pc < LBUFSIZE)
+                fillbuf(fs);
+            char *p = fs->pc;
+            char *nl = memchr(p, '\n', fs->pe - p);
+            if (nl == NULL)
+                goto slow;
+            while (p < nl && israwblank(*p))
+                p++;
+            if (p < nl && (*p == '#' || nl[-1] == '\\' ||
+                           memchr(p, '/', nl - p)))
+                goto slow;
+            fs->pc = nl + 1;
+            fs->line++;
+            fs->column = 0;
+            continue;
+        }
+
+    slow:;
+        int c = rawc(fs);
+        if (c == EOI)
+            break;
+
+        switch (state) {
+        case RAW_CODE:
+            if (c == '\n') {
+                bol = true;
+            } else if (israwblank(c)) {
+                // keep 'bol'
+            } else if (c == '/' && rawnext(fs, '*')) {
+                state = RAW_BLOCK_COMMENT;
+            } else if (c == '/' && rawnext(fs, '/')) {
+                state = RAW_LINE_COMMENT;
+            } else if (c == '#' && bol) {
+                *src = (struct source) {
+                    .file = fs->name,.line = fs->line,.column = fs->column};
+                bol = false;
+                if (!skip_rawblanks(fs))
+                    break;
+                const char *name = rawname(fs);
+                if (name == NULL)
+                    break;
+                if (!strcmp(name, "if") || !strcmp(name, "ifdef")
+                    || !strcmp(name, "ifndef")) {
+                    nest++;
+                } else if (!nest &&
+                           (!strcmp(name, "elif") || !strcmp(name, "else")
+                            || !strcmp(name, "endif"))) {
+                    found = name;
+                    goto out;
+                } else if (nest && !strcmp(name, "endif")) {
+                    nest--;
+                }
+            } else {
+                if (c == '"' || c == '\'') {
+                    state = RAW_SEQUENCE;
+                    sep = c;
+                }
+                bol = false;
+            }
+            break;
+
+        case RAW_BLOCK_COMMENT:
+            if (c == '*' && rawnext(fs, '/'))
+                state = RAW_CODE;
+            break;
+
+        case RAW_LINE_COMMENT:
+            if (c == '\n') {
+                state = RAW_CODE;
+                bol = true;
+            }
+            break;
+
+        case RAW_SEQUENCE:
+            if (c == '\\') {
+                rawc(fs);
+            } else if (c == sep) {
+                state = RAW_CODE;
+            } else if (c == '\n') {
+                // unterminated
+                state = RAW_CODE;
+                bol = true;
+            }
+            break;
+        }
+    }
+
+ out:
+    // readc history before the skip is no longer valid
+    history(EOI, fs->line, fs->column);
+    *lines += fs->line - line;
+    return found;
+}
+
 static struct file *new_file(int kind)
 {
     /**
@@ -299,13 +519,24 @@ struct file *with_file(const char *file, const char *name)
     return fs;
 }
 
+struct file *with_tokens(struct vector *v, const char *name)
+{
+    struct file *fs = new_file(FILE_KIND_TOKENS);
+    fs->name = name;
+    fs->cache = v;
+    return fs;
+}
+
+// Read the tokens of 'v' in order, 'v' is left unchanged.
 struct file *with_buffer(struct vector *v)
 {
     struct file *fs = new_file(FILE_KIND_STRING);
     fs->name = current_file()->name;
     fs->line = current_file()->line;
     fs->column = current_file()->column;
-    vec_add(fs->buffer, v);
+    // the buffer is popped from the tail
+    for (int i = vec_len(v) - 1; i >= 0; i--)
+        vec_push(fs->buffer, vec_at(v, i));
     return fs;
 }
 
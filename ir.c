@@ -17,23 +17,27 @@ static void emit_bool_expr(node_t *n);
 static void emit_bop_bool(node_t *n);
 static void emit_bss(node_t *decl);
 static void emit_data(node_t *decl);
-static void emit_funcdef_gdata(node_t *decl);
+static void emit_funcdef_gdata(node_t *decl, struct region *region);
 static const char *get_string_literal_label(const char *name);
 static void emit_assign(node_t *ty, struct operand *l, node_t *r);
-
-static struct tac *func_tac_head;
-static struct tac *func_tac_tail;
-static struct vector *extra_lvars;
-static struct table *tmps;
-static struct table *labels;
-static struct externals *exts;
-static const char *fall = (const char *)&fall;
-static const char *__continue;
-static const char *__break;
+static node_t *reduce(node_t *n);
+static bool issigned(node_t *ty);
+
+static THREAD_LOCAL struct tac *func_tac_head;
+static THREAD_LOCAL struct tac *func_tac_tail;
+static THREAD_LOCAL struct vector *extra_lvars;
+static THREAD_LOCAL struct map *labels;      // label syms by number
+static THREAD_LOCAL struct map *iconsts;     // int literal syms by value
+static THREAD_LOCAL struct map *uconsts;     // unsigned literal syms by value
+static THREAD_LOCAL long ntmps;
+static THREAD_LOCAL struct externals *exts;
+static const long fall = -1;
+static THREAD_LOCAL long __continue;
+static THREAD_LOCAL long __break;
 
 #define SET_LOOP_CONTEXT(con, brk)              \
-    const char *saved_continue = __continue;    \
-    const char *saved_break = __break;          \
+    long saved_continue = __continue;           \
+    long saved_break = __break;                 \
     __continue = con;                           \
     __break = brk
 
@@ -42,7 +46,7 @@ static const char *__break;
     __break = saved_break
 
 #define SET_SWITCH_CONTEXT(brk)                 \
-    const char *saved_break = __break;          \
+    long saved_break = __break;                 \
     __break = brk
 
 #define RESTORE_SWITCH_CONTEXT()                \
@@ -76,63 +80,82 @@ static void emit_tac(struct tac *tac)
 
 static struct operand * make_sym_operand(node_t *sym)
 {
-    struct operand *operand = zmalloc(sizeof(struct operand));
+    struct operand *operand = ralloc(REGION_FUNC, sizeof(struct operand));
     operand->sym = sym;
     return operand;
 }
 
-static struct operand * make_named_operand(const char *name, struct table **table, int scope)
+/* Temporaries and labels are numbered, the number is kept
+ * in the value of the symbol. They are named only when the
+ * IR is printed.
+ */
+static struct operand * make_tmp_operand(void)
 {
-    node_t *sym = lookup(name, *table);
-    if (!sym)
-        sym = install(name, table, scope);
+    node_t *sym = alloc_symbol();
+    SYM_SCOPE(sym) = GLOBAL;
+    SYM_VALUE_U(sym) = ntmps++;
+    SYM_X_KIND(sym) = SYM_KIND_TMP;
     return make_sym_operand(sym);
 }
 
-static struct operand * make_tmp_operand(void)
+static struct operand * make_label_operand(long label)
 {
-    struct operand *operand = make_named_operand(gen_tmpname_r(), &tmps, GLOBAL);
-    SYM_X_KIND(operand->sym) = SYM_KIND_TMP;
-    return operand;
+    cc_assert(label > 0);
+    node_t *sym = map_get(labels, (void *)label);
+    if (!sym) {
+        sym = alloc_symbol();
+        SYM_SCOPE(sym) = GLOBAL;
+        SYM_VALUE_U(sym) = label;
+        SYM_X_KIND(sym) = SYM_KIND_LABEL;
+        map_put(labels, (void *)label, sym);
+    }
+    return make_sym_operand(sym);
 }
 
-static struct operand * make_label_operand(const char *label)
+static node_t * make_literal_sym(const char *name)
 {
-    struct operand *operand = make_named_operand(label, &labels, GLOBAL);
-    SYM_X_KIND(operand->sym) = SYM_KIND_LABEL;
-    return operand;
+    node_t *sym = alloc_symbol();
+    SYM_SCOPE(sym) = CONSTANT;
+    SYM_NAME(sym) = SYM_X_LABEL(sym) = name;
+    SYM_X_KIND(sym) = SYM_KIND_LITERAL;
+    return sym;
 }
 
+// one symbol per value
 static struct operand * make_int_operand(long long i)
 {
-    struct operand *operand = make_named_operand(strd(i), &constants, CONSTANT);
-    SYM_VALUE_I(operand->sym) = i;
-    SYM_X_KIND(operand->sym) = SYM_KIND_LITERAL;
-    return operand;
+    node_t *sym = map_get(iconsts, (void *)(intptr_t)i);
+    if (!sym) {
+        sym = make_literal_sym(strd(i));
+        SYM_VALUE_I(sym) = i;
+        map_put(iconsts, (void *)(intptr_t)i, sym);
+    }
+    return make_sym_operand(sym);
 }
 
 static struct operand * make_unsigned_operand(unsigned long long u)
 {
-    struct operand *operand = make_named_operand(stru(u), &constants, CONSTANT);
-    SYM_VALUE_U(operand->sym) = u;
-    SYM_X_KIND(operand->sym) = SYM_KIND_LITERAL;
-    return operand;
+    // spelled the same as the int
+    if (u <= LLONG_MAX)
+        return make_int_operand(u);
+
+    node_t *sym = map_get(uconsts, (void *)(uintptr_t)u);
+    if (!sym) {
+        sym = make_literal_sym(stru(u));
+        SYM_VALUE_U(sym) = u;
+        map_put(uconsts, (void *)(uintptr_t)u, sym);
+    }
+    return make_sym_operand(sym);
 }
 
 static struct operand * make_operand_one(void)
 {
-    static struct operand *operand_one;
-    if (!operand_one)
-        operand_one = make_int_operand(1);
-    return operand_one;
+    return make_int_operand(1);
 }
 
 static struct operand * make_operand_zero(void)
 {
-    static struct operand *operand_zero;
-    if (!operand_zero)
-        operand_zero = make_int_operand(0);
-    return operand_zero;
+    return make_int_operand(0);
 }
 
 static struct operand * make_subscript_operand(struct operand *array, struct operand *index)
@@ -164,7 +187,7 @@ static struct tac * make_tac(unsigned op,
                              struct operand *result,
                              unsigned opsize)
 {
-    struct tac *tac = zmalloc(sizeof(struct tac));
+    struct tac *tac = ralloc(REGION_FUNC, sizeof(struct tac));
     tac->op = op;
     tac->args[0] = l;
     tac->args[1] = r;
@@ -195,7 +218,7 @@ static struct tac * make_assign_tac(unsigned op,
 }
 
 static void emit_simple_if(unsigned op, struct operand *operand,
-                           const char *label, unsigned opsize)
+                           long label, unsigned opsize)
 {
     struct tac *tac = make_tac(op, operand, NULL, make_label_operand(label), opsize);
     emit_tac(tac);
@@ -204,22 +227,23 @@ static void emit_simple_if(unsigned op, struct operand *operand,
 static void emit_rel_if(unsigned op,
                         unsigned relop,
                         struct operand *rel_l, struct operand *rel_r,
-                        const char *label,
-                        unsigned opsize)
+                        long label,
+                        unsigned opsize, bool sign)
 {
     struct tac *tac = make_tac(op, rel_l, rel_r, make_label_operand(label), opsize);
     tac->relop = relop;
+    tac->sign = sign;
     emit_tac(tac);
 }
 
-static void emit_label(const char *label)
+static void emit_label(long label)
 {
     struct operand *operand = make_label_operand(label);
     struct tac *tac = make_tac(IR_LABEL, NULL, NULL, operand, Zero);
     emit_tac(tac);
 }
 
-static void emit_goto(const char *label)
+static void emit_goto(long label)
 {
     struct operand *operand = make_label_operand(label);
     struct tac *tac = make_tac(IR_GOTO, NULL, NULL, operand, Zero);
@@ -270,6 +294,7 @@ static void emit_decl(node_t *decl)
         return;
     
     struct operand *l = make_sym_operand(sym);
+    init = reduce(init);
     emit_expr(init);
     emit_assign(SYM_TYPE(sym), l, init);
 }
@@ -506,13 +531,23 @@ static void emit_assign(node_t *ty, struct operand *l, node_t *r)
         emit_assign_scalar(ty, l, r);
 }
 
+/**
+ * The right side of a compound assignment refers to the
+ * lvalue node of the left, whose address is computed (and
+ * side effects evaluated) only once.
+ */
+static THREAD_LOCAL node_t *__assigned;
+
 static void emit_bop_assign(node_t *n)
 {
     node_t *l = EXPR_OPERAND(n, 0);
     node_t *r = EXPR_OPERAND(n, 1);
+    node_t *saved = __assigned;
 
     emit_expr(l);
+    __assigned = l;
     emit_expr(r);
+    __assigned = saved;
     // TODO: bit-field assign
     emit_assign(AST_TYPE(l), EXPR_X_ADDR(l), r);
     EXPR_X_ADDR(n) = EXPR_X_ADDR(l);
@@ -532,7 +567,7 @@ static void emit_bop_bool(node_t *n)
     unsigned opsize = ops[TYPE_SIZE(AST_TYPE(n))];
     EXPR_X_TRUE(n) = fall;
     EXPR_X_FALSE(n) = gen_label();
-    const char *label = gen_label();
+    long label = gen_label();
     struct operand *result = make_tmp_operand();
     emit_bool_expr(n);
     // true
@@ -729,7 +764,7 @@ static void emit_cond(node_t *n)
 
     EXPR_X_TRUE(cond) = fall;
     EXPR_X_FALSE(cond) = gen_label();
-    const char *label = gen_label();
+    long label = gen_label();
     struct operand *result;
     if (isrecord(AST_TYPE(n)))
         result = make_extra_decl(AST_TYPE(n));
@@ -982,7 +1017,10 @@ static void emit_paren(node_t *n)
 static void emit_integer_literal(node_t *n)
 {
     node_t *sym = EXPR_SYM(n);
-    SYM_X_LABEL(sym) = stru(SYM_VALUE_U(sym));
+    if (TYPE_OP(AST_TYPE(n)) == INT)
+        SYM_X_LABEL(sym) = strd(SYM_VALUE_I(sym));
+    else
+        SYM_X_LABEL(sym) = stru(SYM_VALUE_U(sym));
     SYM_X_KIND(sym) = SYM_KIND_LITERAL;
     EXPR_X_ADDR(n) = make_sym_operand(sym);
 }
@@ -1037,6 +1075,8 @@ static void emit_ref(node_t *n)
 static void emit_expr(node_t *n)
 {
     cc_assert(isexpr(n));
+    if (n == __assigned)
+        return;
 
     switch (AST_ID(n)) {
     case BINARY_OPERATOR:
@@ -1159,6 +1199,7 @@ static void emit_rel_expr(node_t *n)
     int relop = EXPR_OP(n);
     node_t *ty = AST_TYPE(n);
     unsigned opsize = ops[TYPE_SIZE(ty)];
+    bool sign = issigned(AST_TYPE(l));
 
     emit_expr(l);
     emit_expr(r);
@@ -1169,7 +1210,7 @@ static void emit_rel_expr(node_t *n)
         emit_rel_if(op,
                     relop, EXPR_X_ADDR(l), EXPR_X_ADDR(r),
                     EXPR_X_TRUE(n),
-                    opsize);
+                    opsize, sign);
         emit_goto(EXPR_X_FALSE(n));
         
     } else if (EXPR_X_TRUE(n) != fall) {
@@ -1178,7 +1219,7 @@ static void emit_rel_expr(node_t *n)
         emit_rel_if(op,
                     relop, EXPR_X_ADDR(l), EXPR_X_ADDR(r),
                     EXPR_X_TRUE(n),
-                    opsize);
+                    opsize, sign);
         
     } else if (EXPR_X_FALSE(n) != fall) {
 
@@ -1186,7 +1227,7 @@ static void emit_rel_expr(node_t *n)
         emit_rel_if(op,
                     relop, EXPR_X_ADDR(l), EXPR_X_ADDR(r),
                     EXPR_X_FALSE(n),
-                    opsize);
+                    opsize, sign);
     } else {
         // both fall
     }
@@ -1237,7 +1278,8 @@ static void emit_bool_expr(node_t *n)
 static void emit_compound_stmt(node_t *stmt)
 {
     node_t **blks = STMT_BLKS(stmt);
-    for (int i = 0; i < LIST_LEN(blks); i++) {
+    int len = LIST_LEN(blks);
+    for (int i = 0; i < len; i++) {
         node_t *node = blks[i];
         if (isdecl(node)) {
             emit_decl(node);
@@ -1245,25 +1287,32 @@ static void emit_compound_stmt(node_t *stmt)
             STMT_X_NEXT(node) = gen_label();
             emit_stmt(node);
         } else if (isexpr(node)) {
-            emit_expr(node);
+            emit_expr(reduce(node));
         } else {
             cc_assert(0);
         }
     }
 }
 
+// the body of a statement may be an expression
+static void set_next(node_t *body, long next)
+{
+    if (isstmt(body))
+        STMT_X_NEXT(body) = next;
+}
+
 static void emit_if_stmt(node_t *stmt)
 {
-    node_t *cond = STMT_COND(stmt);
+    node_t *cond = reduce(STMT_COND(stmt));
     node_t *then = STMT_THEN(stmt);
     node_t *els = STMT_ELSE(stmt);
 
     EXPR_X_TRUE(cond) = fall;
-    STMT_X_NEXT(then) = STMT_X_NEXT(stmt);
+    set_next(then, STMT_X_NEXT(stmt));
 
     if (els) {
         EXPR_X_FALSE(cond) = gen_label();
-        STMT_X_NEXT(els) = STMT_X_NEXT(stmt);
+        set_next(els, STMT_X_NEXT(stmt));
         emit_bool_expr(cond);
         emit_stmt(then);
         emit_goto(STMT_X_NEXT(stmt));
@@ -1279,13 +1328,13 @@ static void emit_if_stmt(node_t *stmt)
 
 static void emit_while_stmt(node_t *stmt)
 {
-    const char *beg = gen_label();
-    node_t *cond = STMT_WHILE_COND(stmt);
+    long beg = gen_label();
+    node_t *cond = reduce(STMT_WHILE_COND(stmt));
     node_t *body = STMT_WHILE_BODY(stmt);
 
     EXPR_X_TRUE(cond) = fall;
     EXPR_X_FALSE(cond) = STMT_X_NEXT(stmt);
-    STMT_X_NEXT(body) = STMT_X_NEXT(stmt);
+    set_next(body, STMT_X_NEXT(stmt));
 
     emit_label(beg);
     emit_bool_expr(cond);
@@ -1300,13 +1349,13 @@ static void emit_while_stmt(node_t *stmt)
 
 static void emit_do_while_stmt(node_t *stmt)
 {
-    const char *beg = gen_label();
-    node_t *cond = STMT_WHILE_COND(stmt);
+    long beg = gen_label();
+    node_t *cond = reduce(STMT_WHILE_COND(stmt));
     node_t *body = STMT_WHILE_BODY(stmt);
 
     EXPR_X_TRUE(cond) = beg;
     EXPR_X_FALSE(cond) = fall;
-    STMT_X_NEXT(body) = STMT_X_NEXT(stmt); 
+    set_next(body, STMT_X_NEXT(stmt)); 
 
     emit_label(beg);
 
@@ -1326,17 +1375,18 @@ static void emit_for_stmt(node_t *stmt)
     node_t *ctrl = STMT_FOR_CTRL(stmt);
     node_t *body = STMT_FOR_BODY(stmt);
 
-    const char *beg = gen_label();
-    const char *mid = gen_label();
+    long beg = gen_label();
+    long mid = gen_label();
     
     if (decl)
         emit_decls(decl);
     else if (init)
-        emit_expr(init);
+        emit_expr(reduce(init));
 
     emit_label(beg);
 
     if (cond) {
+        cond = reduce(cond);
         EXPR_X_TRUE(cond) = fall;
         EXPR_X_FALSE(cond) = STMT_X_NEXT(stmt);
         emit_bool_expr(cond);
@@ -1344,7 +1394,7 @@ static void emit_for_stmt(node_t *stmt)
 
     SET_LOOP_CONTEXT(beg, STMT_X_NEXT(stmt));
     
-    STMT_X_NEXT(body) = STMT_X_NEXT(stmt);
+    set_next(body, STMT_X_NEXT(stmt));
     emit_stmt(body);
 
     RESTORE_LOOP_CONTEXT();
@@ -1352,7 +1402,7 @@ static void emit_for_stmt(node_t *stmt)
     emit_label(mid);
     
     if (ctrl)
-        emit_expr(ctrl);
+        emit_expr(reduce(ctrl));
     
     emit_goto(beg);
     emit_label(STMT_X_NEXT(stmt));
@@ -1363,36 +1413,65 @@ static void emit_switch_jmp(node_t *cond, node_t *case_stmt)
     node_t *ty = AST_TYPE(cond);
     struct operand *cond_operand = EXPR_X_ADDR(cond);
     struct operand *case_operand = make_int_operand(STMT_CASE_INDEX(case_stmt));
-    STMT_X_LABEL(case_stmt) = gen_label();
 
     emit_rel_if(IR_IF_I,
                 EQ, cond_operand, case_operand,
                 STMT_X_LABEL(case_stmt),
-                ops[TYPE_SIZE(ty)]);
+                ops[TYPE_SIZE(ty)], issigned(ty));
+}
+
+#define SWITCH_LINEAR  8
+
+/* The cases come sorted by value in the switch type. A few
+ * are tested one by one, more are split in halves by a '<'
+ * test first, which compares with the same signedness.
+ */
+static void emit_switch_search(node_t *cond, node_t **cases,
+                               int lo, int hi, long deflt)
+{
+    if (hi - lo <= SWITCH_LINEAR) {
+        for (int i = lo; i < hi; i++)
+            emit_switch_jmp(cond, cases[i]);
+        emit_goto(deflt);
+        return;
+    }
+
+    node_t *ty = AST_TYPE(cond);
+    int mid = lo + (hi - lo) / 2;
+    long left = gen_label();
+    emit_rel_if(IR_IF_I,
+                '<', EXPR_X_ADDR(cond),
+                make_int_operand(STMT_CASE_INDEX(cases[mid])),
+                left,
+                ops[TYPE_SIZE(ty)], issigned(ty));
+    emit_switch_search(cond, cases, mid, hi, deflt);
+    emit_label(left);
+    emit_switch_search(cond, cases, lo, mid, deflt);
 }
 
 static void emit_switch_stmt(node_t *stmt)
 {
-    node_t *expr = STMT_SWITCH_EXPR(stmt);
+    node_t *expr = reduce(STMT_SWITCH_EXPR(stmt));
     node_t *body = STMT_SWITCH_BODY(stmt);
     node_t **cases = STMT_SWITCH_CASES(stmt);
+    int len = LIST_LEN(cases);
 
     emit_expr(expr);
-    
-    for (int i = 0; i < LIST_LEN(cases); i++) {
-        node_t *case_stmt = cases[i];
-        emit_switch_jmp(expr, case_stmt);
-    }
 
+    for (int i = 0; i < len; i++)
+        STMT_X_LABEL(cases[i]) = gen_label();
+
+    long deflt;
     node_t *default_stmt = STMT_SWITCH_DEFAULT(stmt);
     if (default_stmt) {
-        const char *label = gen_label();
-        STMT_X_LABEL(default_stmt) = label;
-        emit_goto(label);
+        deflt = gen_label();
+        STMT_X_LABEL(default_stmt) = deflt;
     } else {
-        emit_goto(STMT_X_NEXT(stmt));
+        deflt = STMT_X_NEXT(stmt);
     }
 
+    emit_switch_search(expr, cases, 0, len, deflt);
+
     SET_SWITCH_CONTEXT(STMT_X_NEXT(stmt));
     emit_stmt(body);
     RESTORE_SWITCH_CONTEXT();
@@ -1434,7 +1513,7 @@ static void emit_continue_stmt(node_t *stmt)
 
 static void emit_return_stmt(node_t *stmt)
 {
-    node_t *n = STMT_RETURN_EXPR(stmt);
+    node_t *n = reduce(STMT_RETURN_EXPR(stmt));
     node_t *ty = AST_TYPE(n);
     unsigned op = isfloat(ty) ? IR_RETURNF : IR_RETURNI;
     
@@ -1493,7 +1572,7 @@ static void emit_stmt(node_t *stmt)
         // do nothing
         break;
     default:
-        emit_expr(stmt);
+        emit_expr(reduce(stmt));
         break;
     }
 }
@@ -1501,6 +1580,9 @@ static void emit_stmt(node_t *stmt)
 static void emit_function(node_t *decl)
 {
     node_t *stmt = DECL_BODY(decl);
+    // freed when the function is emitted
+    struct region *region = new_region();
+    struct region *saved = set_region(REGION_FUNC, region);
 
     func_tac_head = NULL;
     func_tac_tail = NULL;
@@ -1516,7 +1598,8 @@ static void emit_function(node_t *decl)
         vec_add(v, extra_lvars);
         DECL_X_LVARS(decl) = (node_t **)vtoa(v);
     }
-    emit_funcdef_gdata(decl);
+    set_region(REGION_FUNC, saved);
+    emit_funcdef_gdata(decl, region);
 }
 
 static void emit_globalvar(node_t *n)
@@ -1531,9 +1614,10 @@ static void emit_globalvar(node_t *n)
 
 static void ir_init(void)
 {
-    tmps = new_table(NULL, GLOBAL);
-    labels = new_table(NULL, GLOBAL);
-    exts = zmalloc(sizeof(struct externals));
+    labels = ptrmap_new();
+    iconsts = ptrmap_new();
+    uconsts = ptrmap_new();
+    exts = ralloc(REGION_TU, sizeof(struct externals));
     exts->gdatas = vec_new();
     exts->strings = dict_new();
     exts->compounds = dict_new();
@@ -1568,15 +1652,474 @@ struct externals * ir(node_t *tree)
     return exts;
 }
 
-node_t * reduce(node_t *expr)
+/* Expression simplification
+ *
+ * reduce() rewrites an expression before it is emitted:
+ *
+ * - integer constant subtrees are folded
+ * - algebraic identities: x+0, x*1, x*0, x&0, x|0, x<<0 ...
+ * - constants of + * & | ^ chains are reassociated
+ * - no-op conversions and integer conversion chains collapse
+ * - &*p, !!b, --x and ~~x, parens and pure comma operands go
+ * - a constant condition of ?:, && and || drops the dead arm
+ *
+ * An operand is only dropped if it has no side effects,
+ * reading a volatile object being one. Floating point is
+ * left alone. The tree is not modified, a rewritten node
+ * is a copy.
+ */
+static bool impure(node_t *n)
+{
+    if (isvolatile(AST_TYPE(n)))
+        return true;
+
+    switch (AST_ID(n)) {
+    case BINARY_OPERATOR:
+        if (EXPR_OP(n) == '=')
+            return true;
+        return impure(EXPR_OPERAND(n, 0)) || impure(EXPR_OPERAND(n, 1));
+    case UNARY_OPERATOR:
+        if (EXPR_OP(n) == SIZEOF)
+            return false;
+        if (EXPR_OP(n) == INCR || EXPR_OP(n) == DECR)
+            return true;
+        return impure(EXPR_OPERAND(n, 0));
+    case SUBSCRIPT_EXPR:
+        return impure(EXPR_OPERAND(n, 0)) || impure(EXPR_OPERAND(n, 1));
+    case COND_EXPR:
+        return impure(EXPR_COND(n)) || impure(EXPR_THEN(n)) ||
+            impure(EXPR_ELSE(n));
+    case PAREN_EXPR:
+    case MEMBER_EXPR:
+    case CAST_EXPR:
+    case CONV_EXPR:
+        return impure(EXPR_OPERAND(n, 0));
+    case REF_EXPR:
+    case INTEGER_LITERAL:
+    case FLOAT_LITERAL:
+    case STRING_LITERAL:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static bool issigned(node_t *ty)
+{
+    return TYPE_OP(unpack(unqual(ty))) == INT;
+}
+
+// the value 'v' converted to the integer type 'ty'
+static unsigned long long int_value(node_t *ty, unsigned long long v)
+{
+    if (isbool(ty))
+        return v != 0;
+
+    int bits = TYPE_SIZE(ty) * 8;
+    if (bits >= 64)
+        return v;
+    unsigned long long mask = (1ULL << bits) - 1;
+    v &= mask;
+    if (issigned(ty) && (v >> (bits - 1)))
+        v |= ~mask;
+    return v;
+}
+
+static node_t *int_literal(node_t *ty, unsigned long long v)
+{
+    node_t *sym = anonymous(constants, CONSTANT);
+    SYM_TYPE(sym) = unqual(ty);
+    SYM_VALUE_U(sym) = int_value(ty, v);
+    node_t *n = ast_expr(INTEGER_LITERAL, unqual(ty), NULL, NULL);
+    EXPR_SYM(n) = sym;
+    return n;
+}
+
+static bool isintconst(node_t *n)
+{
+    return isiliteral(n) && isint(AST_TYPE(n));
+}
+
+static unsigned long long const_value(node_t *n)
+{
+    return int_value(AST_TYPE(n), ILITERAL_VALUE(n));
+}
+
+static bool iszero(node_t *n)
+{
+    return isintconst(n) && const_value(n) == 0;
+}
+
+static bool isone(node_t *n)
+{
+    return isintconst(n) && const_value(n) == 1;
+}
+
+// an int that is 0 or 1
+static bool isboolean(node_t *n)
+{
+    if (AST_ID(n) == UNARY_OPERATOR)
+        return EXPR_OP(n) == '!';
+    if (AST_ID(n) != BINARY_OPERATOR)
+        return false;
+    switch (EXPR_OP(n)) {
+    case AND: case OR: case EQ: case NEQ:
+    case '<': case '>': case LEQ: case GEQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool same_type(node_t *ty1, node_t *ty2)
+{
+    return eqtype(unqual(ty1), unqual(ty2));
+}
+
+static node_t *with_operands(node_t *n, node_t *l, node_t *r)
+{
+    if (l == EXPR_OPERAND(n, 0) && r == EXPR_OPERAND(n, 1))
+        return n;
+    n = copy_node(n);
+    EXPR_OPERAND(n, 0) = l;
+    EXPR_OPERAND(n, 1) = r;
+    return n;
+}
+
+// fold 'l op r', both integer constants
+static node_t *fold_bop(node_t *n, node_t *l, node_t *r)
+{
+    node_t *ty = AST_TYPE(n);
+    if (!isint(ty) || !isintconst(l) || !isintconst(r))
+        return NULL;
+
+    unsigned long long a = const_value(l);
+    unsigned long long b = const_value(r);
+    bool s = issigned(AST_TYPE(l));
+    unsigned long long v;
+
+    switch (EXPR_OP(n)) {
+    case '+': v = a + b; break;
+    case '-': v = a - b; break;
+    case '*': v = a * b; break;
+    case '&': v = a & b; break;
+    case '|': v = a | b; break;
+    case '^': v = a ^ b; break;
+    case '/':
+    case '%':
+        if (b == 0)
+            return NULL;
+        if (s && (long long)b == -1)
+            v = EXPR_OP(n) == '/' ? -a : 0;
+        else if (s)
+            v = EXPR_OP(n) == '/' ? (long long)a / (long long)b
+                : (long long)a % (long long)b;
+        else
+            v = EXPR_OP(n) == '/' ? a / b : a % b;
+        break;
+    case LSHIFT:
+    case RSHIFT:
+        if (b >= TYPE_SIZE(ty) * 8)
+            return NULL;
+        if (EXPR_OP(n) == LSHIFT)
+            v = a << b;
+        else
+            v = s ? (unsigned long long)((long long)a >> b) : a >> b;
+        break;
+    case EQ: v = a == b; break;
+    case NEQ: v = a != b; break;
+    case '<': v = s ? (long long)a < (long long)b : a < b; break;
+    case '>': v = s ? (long long)a > (long long)b : a > b; break;
+    case LEQ: v = s ? (long long)a <= (long long)b : a <= b; break;
+    case GEQ: v = s ? (long long)a >= (long long)b : a >= b; break;
+    default:
+        return NULL;
+    }
+
+    return int_literal(ty, v);
+}
+
+static bool iscommutative(int op)
+{
+    return op == '+' || op == '*' || op == '&' || op == '|' || op == '^';
+}
+
+/**
+ * A compound assignment 'l op= r' is 'l = l op r' with one
+ * lvalue node on both sides, and the IR reuses the address
+ * it computed for the node. The left side is reduced once
+ * and the result stands in for the node on the right.
+ */
+static THREAD_LOCAL node_t *__lvalue;
+static THREAD_LOCAL node_t *__reduced_lvalue;
+
+static node_t *reduce_assign(node_t *n)
+{
+    node_t *saved = __lvalue;
+    node_t *saved_reduced = __reduced_lvalue;
+    node_t *l = reduce(EXPR_OPERAND(n, 0));
+
+    __lvalue = EXPR_OPERAND(n, 0);
+    __reduced_lvalue = l;
+    node_t *r = reduce(EXPR_OPERAND(n, 1));
+    __lvalue = saved;
+    __reduced_lvalue = saved_reduced;
+
+    // 'z -= 0' or 'z *= 1' leaves 'z' as it is
+    if (r == l && !isvolatile(AST_TYPE(l)))
+        return l;
+    return with_operands(n, l, r);
+}
+
+static node_t *reduce_bop(node_t *n)
 {
-    return expr;
+    int op = EXPR_OP(n);
+    if (op == '=')
+        return reduce_assign(n);
+
+    node_t *ty = AST_TYPE(n);
+    node_t *l = reduce(EXPR_OPERAND(n, 0));
+    node_t *r = reduce(EXPR_OPERAND(n, 1));
+    node_t *folded;
+
+    switch (op) {
+    case ',':
+        return impure(l) ? with_operands(n, l, r) : r;
+    case AND:
+    case OR:
+        if (isintconst(l)) {
+            // the value of the left side decides
+            if ((const_value(l) != 0) == (op == OR))
+                return int_literal(ty, op == OR);
+            if (isboolean(r))
+                return r;
+            if (isintconst(r))
+                return int_literal(ty, const_value(r) != 0);
+        }
+        return with_operands(n, l, r);
+    }
+
+    if ((folded = fold_bop(n, l, r)))
+        return folded;
+    if (!isint(ty)) {
+        // pointer + 0
+        if ((op == '+' || op == '-') && iszero(r) && same_type(ty, AST_TYPE(l)))
+            return l;
+        if (op == '+' && iszero(l) && same_type(ty, AST_TYPE(r)))
+            return r;
+        return with_operands(n, l, r);
+    }
+
+    // constants on the right
+    if (iscommutative(op) && isintconst(l) && !isintconst(r)) {
+        node_t *t = l;
+        l = r;
+        r = t;
+    }
+
+    // (x op c1) op c2 => x op (c1 op c2)
+    if (iscommutative(op) && isintconst(r) &&
+        AST_ID(l) == BINARY_OPERATOR && EXPR_OP(l) == op &&
+        same_type(AST_TYPE(l), ty) &&
+        isintconst(EXPR_OPERAND(l, 1)) &&
+        same_type(AST_TYPE(EXPR_OPERAND(l, 1)), AST_TYPE(r))) {
+        node_t *c = with_operands(n, EXPR_OPERAND(l, 1), r);
+        if ((folded = fold_bop(c, EXPR_OPERAND(l, 1), r))) {
+            l = EXPR_OPERAND(l, 0);
+            r = folded;
+        }
+    }
+
+    if (isintconst(r) && same_type(AST_TYPE(l), ty)) {
+        switch (op) {
+        case '+': case '-': case '|': case '^':
+        case LSHIFT: case RSHIFT:
+            if (iszero(r))
+                return l;
+            break;
+        case '*': case '/':
+            if (isone(r))
+                return l;
+            if (op == '*' && iszero(r) && !impure(l))
+                return int_literal(ty, 0);
+            break;
+        case '&':
+            if (iszero(r) && !impure(l))
+                return int_literal(ty, 0);
+            break;
+        }
+    }
+
+    return with_operands(n, l, r);
+}
+
+static node_t *reduce_uop(node_t *n)
+{
+    int op = EXPR_OP(n);
+    node_t *ty = AST_TYPE(n);
+
+    if (op == SIZEOF)
+        return n;
+
+    node_t *l = reduce(EXPR_OPERAND(n, 0));
+
+    if (isintconst(l) && isint(ty)) {
+        unsigned long long v = const_value(l);
+        switch (op) {
+        case '+': return int_literal(ty, v);
+        case '-': return int_literal(ty, -v);
+        case '~': return int_literal(ty, ~v);
+        case '!': return int_literal(ty, v == 0);
+        }
+    }
+
+    switch (op) {
+    case '+':
+        if (same_type(AST_TYPE(l), ty))
+            return l;
+        break;
+    case '-':
+    case '~':
+        // --x, ~~x
+        if (isint(ty) && AST_ID(l) == UNARY_OPERATOR && EXPR_OP(l) == op &&
+            same_type(AST_TYPE(EXPR_OPERAND(l, 0)), ty))
+            return EXPR_OPERAND(l, 0);
+        break;
+    case '!':
+        // !!b
+        if (AST_ID(l) == UNARY_OPERATOR && EXPR_OP(l) == '!' &&
+            isboolean(EXPR_OPERAND(l, 0)))
+            return EXPR_OPERAND(l, 0);
+        break;
+    case '&':
+        // &*p
+        if (AST_ID(l) == UNARY_OPERATOR && EXPR_OP(l) == '*' &&
+            same_type(AST_TYPE(EXPR_OPERAND(l, 0)), ty))
+            return EXPR_OPERAND(l, 0);
+        break;
+    }
+
+    return with_operands(n, l, NULL);
+}
+
+static node_t *reduce_conv(node_t *n)
+{
+    node_t *ty = AST_TYPE(n);
+    node_t *l = reduce(EXPR_OPERAND(n, 0));
+    node_t *lty = AST_TYPE(l);
+
+    if (same_type(ty, lty))
+        return l;
+    if (!isint(ty) || !isint(lty))
+        return with_operands(n, l, NULL);
+
+    if (isintconst(l))
+        return int_literal(ty, const_value(l));
+
+    // (T1)(T2)x => (T1)x
+    if ((AST_ID(l) == CONV_EXPR || AST_ID(l) == CAST_EXPR) &&
+        !isbool(ty) && !isbool(lty)) {
+        node_t *x = EXPR_OPERAND(l, 0);
+        node_t *xty = AST_TYPE(x);
+        // T2 keeps what T1 takes, or T2 keeps the value of x
+        if (isint(xty) &&
+            (TYPE_SIZE(lty) >= TYPE_SIZE(ty) ||
+             (TYPE_SIZE(lty) >= TYPE_SIZE(xty) &&
+              issigned(lty) == issigned(xty)))) {
+            if (same_type(ty, xty))
+                return x;
+            return with_operands(n, x, NULL);
+        }
+    }
+
+    return with_operands(n, l, NULL);
+}
+
+static node_t *reduce_cond(node_t *n)
+{
+    node_t *cond = reduce(EXPR_COND(n));
+    node_t *then = reduce(EXPR_THEN(n));
+    node_t *els = reduce(EXPR_ELSE(n));
+
+    if (isintconst(cond)) {
+        node_t *live = const_value(cond) ? then : els;
+        if (same_type(AST_TYPE(live), AST_TYPE(n)))
+            return live;
+    }
+    if (cond == EXPR_COND(n) && then == EXPR_THEN(n) && els == EXPR_ELSE(n))
+        return n;
+
+    n = copy_node(n);
+    EXPR_COND(n) = cond;
+    EXPR_THEN(n) = then;
+    EXPR_ELSE(n) = els;
+    return n;
+}
+
+static node_t *reduce_call(node_t *n)
+{
+    node_t *call = n;
+    node_t *l = reduce(EXPR_OPERAND(n, 0));
+    node_t **args = EXPR_ARGS(n);
+    struct vector *v = NULL;
+
+    for (int i = 0; i < LIST_LEN(args); i++) {
+        node_t *arg = reduce(args[i]);
+        if (arg != args[i] && v == NULL) {
+            v = vec_new();
+            for (int j = 0; j < i; j++)
+                vec_push(v, args[j]);
+        }
+        if (v)
+            vec_push(v, arg);
+    }
+
+    n = with_operands(n, l, EXPR_OPERAND(n, 1));
+    if (v) {
+        if (n == call)
+            n = copy_node(n);
+        EXPR_ARGS(n) = (node_t **) vtoa(v);
+    }
+    return n;
+}
+
+static node_t *reduce(node_t *n)
+{
+    if (n == __lvalue)
+        return __reduced_lvalue;
+
+    switch (AST_ID(n)) {
+    case BINARY_OPERATOR:
+        return reduce_bop(n);
+    case UNARY_OPERATOR:
+        return reduce_uop(n);
+    case PAREN_EXPR:
+        return reduce(EXPR_OPERAND(n, 0));
+    case CAST_EXPR:
+    case CONV_EXPR:
+        return reduce_conv(n);
+    case COND_EXPR:
+        return reduce_cond(n);
+    case CALL_EXPR:
+        return reduce_call(n);
+    case REF_EXPR:
+        if (EXPR_OP(n) == ENUM)
+            return int_literal(AST_TYPE(n), SYM_VALUE_U(EXPR_SYM(n)));
+        return n;
+    case MEMBER_EXPR:
+        return with_operands(n, reduce(EXPR_OPERAND(n, 0)), NULL);
+    case SUBSCRIPT_EXPR:
+        return with_operands(n, reduce(EXPR_OPERAND(n, 0)),
+                             reduce(EXPR_OPERAND(n, 1)));
+    default:
+        return n;
+    }
 }
 
 //
 // decl
 //
-static struct vector *__xvalues;
+static THREAD_LOCAL struct vector *__xvalues;
 
 #define SET_GDATA_CONTEXT()                     \
     struct vector *__saved_xvalues = __xvalues; \
@@ -1592,12 +2135,12 @@ static void emit_initializer(node_t *init);
 
 static inline struct xvalue * alloc_xvalue(void)
 {
-    return zmalloc(sizeof(struct xvalue));
+    return ralloc(REGION_TU, sizeof(struct xvalue));
 }
 
 static inline struct gdata * alloc_gdata(void)
 {
-    return zmalloc(sizeof(struct gdata));
+    return ralloc(REGION_TU, sizeof(struct gdata));
 }
 
 static void emit_xvalue(int size, const char *name)
@@ -1618,7 +2161,7 @@ static void emit_gdata(struct gdata *data)
     vec_push(exts->gdatas, data);
 }
 
-static void emit_funcdef_gdata(node_t *decl)
+static void emit_funcdef_gdata(node_t *decl, struct region *region)
 {
     node_t *sym = DECL_SYM(decl);
     struct gdata *gdata = alloc_gdata();
@@ -1626,6 +2169,7 @@ static void emit_funcdef_gdata(node_t *decl)
     gdata->global = SYM_SCLASS(sym) == STATIC ? false : true;
     gdata->label = SYM_X_LABEL(sym);
     gdata->u.decl = decl;
+    gdata->region = region;
     emit_gdata(gdata);
 }
 
@@ -1758,20 +2302,93 @@ static void emit_struct_initializer(node_t *n)
     }
 }
 
+// the directive size of an integer initializer, Zero if none
+static int int_xsize(node_t *ty)
+{
+    switch (TYPE_KIND(ty)) {
+    case _BOOL:
+    case CHAR:
+        return Byte;
+    case SHORT:
+        return Word;
+    case INT:
+    case UNSIGNED:
+        return Long;
+    case LONG:
+    case LONG+LONG:
+        return Quad;
+    default:
+        return Zero;
+    }
+}
+
+static const char *int_xname(int size, node_t *init)
+{
+    if (size == Quad)
+        return format("%llu", ILITERAL_VALUE(init));
+    else
+        return format("%d", ILITERAL_VALUE(init));
+}
+
+#define PACK_MAX  32
+
+/* Array elements are emitted in runs: holes left by designators
+ * (a VINIT_EXPR may stand for many) become one '.zero' and integer
+ * literals are packed into one directive per PACK_MAX values.
+ */
 static void emit_array_initializer(node_t *n)
 {
     if (issliteral(n)) {
         const char *label = get_ptr_label(n);
         emit_xvalue(Quad, label);
-    } else {
-        cc_assert(AST_ID(n) == INITS_EXPR);
-        int i;
-        for (i = 0; i < LIST_LEN(EXPR_INITS(n)); i++)
-            emit_initializer(EXPR_INITS(n)[i]);
-        int left = TYPE_LEN(AST_TYPE(n)) - i;
-        if (left > 0)
-            emit_zero(left * TYPE_SIZE(rtype(AST_TYPE(n))));
+        return;
     }
+
+    cc_assert(AST_ID(n) == INITS_EXPR);
+    node_t *rty = rtype(AST_TYPE(n));
+    size_t elemsize = TYPE_SIZE(rty);
+    int xsize = int_xsize(rty);
+    node_t **inits = EXPR_INITS(n);
+    int len = LIST_LEN(inits);
+    size_t zeros = 0;
+    size_t nelems = 0;
+    struct strbuf *packed = strbuf_new();
+    int npacked = 0;
+
+    for (int i = 0; i <= len; i++) {
+        node_t *init = i < len ? inits[i] : NULL;
+        bool pack = init && xsize && isiliteral(init);
+
+        if (npacked && (!pack || npacked == PACK_MAX)) {
+            emit_xvalue(xsize, xstrdup(strbuf_str(packed)));
+            strbuf_clear(packed);
+            npacked = 0;
+        }
+        if (init && AST_ID(init) == VINIT_EXPR) {
+            zeros += elemsize * EXPR_VINIT_LEN(init);
+            nelems += EXPR_VINIT_LEN(init);
+            continue;
+        }
+        if (init)
+            nelems++;
+        if (zeros && init) {
+            emit_zero(zeros);
+            zeros = 0;
+        }
+        if (pack) {
+            if (npacked++)
+                strbuf_catc(packed, ',');
+            strbuf_cats(packed, int_xname(xsize, init));
+        } else if (init) {
+            emit_initializer(init);
+        }
+    }
+    strbuf_free(packed);
+
+    if (TYPE_LEN(AST_TYPE(n)) > nelems)
+        zeros += (TYPE_LEN(AST_TYPE(n)) - nelems) * elemsize;
+    if (zeros)
+        emit_zero(zeros);
 }
 
 static void emit_address_initializer(node_t *init)
@@ -1824,18 +2441,12 @@ static void emit_arith_initializer(node_t *init)
     switch (TYPE_KIND(ty)) {
     case _BOOL:
     case CHAR:
-        emit_xvalue(Byte, format("%d", ILITERAL_VALUE(init)));
-        break;
     case SHORT:
-        emit_xvalue(Word, format("%d", ILITERAL_VALUE(init)));
-        break;
     case INT:
     case UNSIGNED:
-        emit_xvalue(Long, format("%d", ILITERAL_VALUE(init)));
-        break;
     case LONG:
     case LONG+LONG:
-        emit_xvalue(Quad, format("%llu", ILITERAL_VALUE(init)));
+        emit_xvalue(int_xsize(ty), int_xname(int_xsize(ty), init));
         break;
     case FLOAT:
         {
@@ -1,4 +1,5 @@
 #include "cc.h"
+#include "sys/sys.h"
 
 static const char *tnames[] = {
 #define _a(a, b, c)     b,
@@ -8,14 +9,30 @@ static const char *tnames[] = {
 #include "token.def"
 };
 
-static struct token *eoi_token = &(struct token){.id = EOI,.name = "EOI" };
-struct token *space_token = &(struct token){.id = ' ',.name = " " };
-struct token *newline_token = &(struct token){.id = '\n',.name = "\n" };
+static THREAD_LOCAL struct token eoi_token = {.id = EOI,.name = "EOI" };
+THREAD_LOCAL struct token space_token = {.id = ' ',.name = " " };
+THREAD_LOCAL struct token newline_token = {.id = '\n',.name = "\n" };
 
-struct source source;
+THREAD_LOCAL struct source source;
 
 #define BOL    (current_file()->bol)
 
+/**
+ * While tokenizing a header for the cache, lexical errors are
+ * only counted. The header is then lexed again from the file,
+ * where the errors are reported as usual.
+ */
+static THREAD_LOCAL bool tokenizing;
+static THREAD_LOCAL unsigned tokenize_errors;
+
+#define lexerror(...)                           \
+    do {                                        \
+        if (tokenizing)                         \
+            tokenize_errors++;                  \
+        else                                    \
+            error(__VA_ARGS__);                 \
+    } while (0)
+
 int isletter(int c)
 {
     return isalpha(c) || c == '_';
@@ -135,15 +152,25 @@ static void block_comment(void)
         if (ch == '*' && next('/'))
             break;
         if (ch == EOI) {
-            error("unterminated /* comment");
+            lexerror("unterminated /* comment");
             break;
         }
     }
 }
 
+// Scratch buffer for the spelling of a token, interned once it's complete.
+static struct strbuf *spelling(void)
+{
+    static THREAD_LOCAL struct strbuf *s;
+    if (!s)
+        s = strbuf_new();
+    strbuf_clear(s);
+    return s;
+}
+
 static struct token *ppnumber(int c)
 {
-    struct strbuf *s = strbuf_new();
+    struct strbuf *s = spelling();
     strbuf_catc(s, c);
     for (;;) {
         int ch = readc();
@@ -166,7 +193,7 @@ static struct token *ppnumber(int c)
 
 static struct token *sequence(bool wide, int sep)
 {
-    struct strbuf *s = strbuf_new();
+    struct strbuf *s = spelling();
 
     if (wide)
         strbuf_catc(s, 'L');
@@ -187,7 +214,7 @@ static struct token *sequence(bool wide, int sep)
     bool is_char = sep == '\'' ? true : false;
     const char *name = is_char ? "character" : "string";
     if (ch != sep)
-        error("untermiated %s constant: %s", name, s->str);
+        lexerror("untermiated %s constant: %s", name, s->str);
     strbuf_catc(s, sep);
 
     if (is_char)
@@ -195,12 +222,12 @@ static struct token *sequence(bool wide, int sep)
                 .id = NCONSTANT,.name = strs(s->str)});
     else
         return make_token(&(struct token) {
-                .id = SCONSTANT,.name = strbuf_str(s)});
+                .id = SCONSTANT,.name = strs(s->str)});
 }
 
 static struct token *identifier(int c)
 {
-    struct strbuf *s = strbuf_new();
+    struct strbuf *s = spelling();
     strbuf_catc(s, c);
     readch(s, isdigitletter);
     return make_token(&(struct token) {
@@ -210,15 +237,15 @@ static struct token *identifier(int c)
 static struct token *newline(void)
 {
     BOL = true;
-    newline_token->src = source;
-    return newline_token;
+    newline_token.src = source;
+    return &newline_token;
 }
 
 static struct token *spaces(int c)
 {
     readch(NULL, iswhitespace);
-    space_token->src = source;
-    return space_token;
+    space_token.src = source;
+    return &space_token;
 }
 
 struct token *dolex(void)
@@ -231,7 +258,7 @@ struct token *dolex(void)
 
         switch (rpc) {
         case EOI:
-            return eoi_token;
+            return &eoi_token;
 
         case '\n':
             return newline();
@@ -526,9 +553,9 @@ struct token *dolex(void)
         default:
             // illegal character
             if (isgraph(rpc))
-                error("illegal character '%c'", rpc);
+                lexerror("illegal character '%c'", rpc);
             else
-                error("illegal character '\\0%o'", rpc);
+                lexerror("illegal character '\\0%o'", rpc);
         }
     }
 }
@@ -546,15 +573,28 @@ static const char *hq_char_sequence(int sep)
     }
 
     if (ch != sep)
-        error("missing '%c' in header name", sep);
+        lexerror("missing '%c' in header name", sep);
 
     skipline(true);
     return strbuf_str(s);
 }
 
+static struct token *cached_header_name(struct file *fs)
+{
+    struct token *t = vec_at_safe(fs->cache, fs->cachep);
+    if (t == NULL || t->id != HEADER)
+        return NULL;
+    fs->cachep++;
+    fs->line = t->src.line;
+    fs->column = t->src.column;
+    return new_token(t);
+}
+
 struct token *header_name(void)
 {
     int ch;
+    if (current_file()->cache)
+        return cached_header_name(current_file());
  beg:
     ch = readc();
     if (iswhitespace(ch))
@@ -564,11 +604,11 @@ struct token *header_name(void)
     if (ch == '<') {
         const char *name = hq_char_sequence('>');
         return new_token(&(struct token) {
-                .name = name,.kind = '<'});
+                .id = HEADER,.name = name,.kind = '<'});
     } else if (ch == '"') {
         const char *name = hq_char_sequence('"');
         return new_token(&(struct token) {
-                .name = name,.kind = '"'});
+                .id = HEADER,.name = name,.kind = '"'});
     } else {
         // pptokens
         unreadc(ch);
@@ -576,6 +616,60 @@ struct token *header_name(void)
     }
 }
 
+/**
+ * Tokenize a whole file without preprocessing, so that the
+ * tokens can be replayed when the file is included again.
+ * Return NULL if the file has lexical errors.
+ */
+struct vector *tokenize(const char *file, const char *name)
+{
+    struct vector *v = vec_new();
+    struct source src = source;
+    bool bol = BOL;
+    bool directive = false;
+
+    tokenizing = true;
+    tokenize_errors = 0;
+    file_sentinel(with_file(file, name));
+    for (;;) {
+        struct token *t = dolex();
+        if (t->id == EOI)
+            break;
+        if (IS_SPACE(t) || IS_NEWLINE(t))
+            t = new_token(t);
+        vec_push(v, t);
+        if (IS_SPACE(t))
+            continue;
+        if (t->id == '#' && t->bol) {
+            directive = true;
+            continue;
+        }
+        if (directive && t->id == ID && !strcmp(t->name, "include")) {
+            // the header name is lexed at character level
+            struct token *h = header_name();
+            if (h) {
+                // position after the directive line
+                h->src = chsrc();
+                vec_push(v, h);
+                BOL = true;
+            }
+        }
+        directive = false;
+    }
+    file_unsentinel();
+    tokenizing = false;
+
+    // restore the includer
+    BOL = bol;
+    source = src;
+
+    if (tokenize_errors) {
+        vec_free(v);
+        return NULL;
+    }
+    return v;
+}
+
 void unget(struct token *t)
 {
     vec_push(current_file()->buffer, t);
@@ -616,16 +710,13 @@ void skip_spaces(void)
     unreadc(ch);
 }
 
-void skip_ifstub(void)
+static void skip_group_tokens(unsigned *lines)
 {
-    /* Skip part of conditional group.
+    /* Skip part of conditional group token by token,
+     * used when characters or tokens are pending.
      */
-    unsigned lines = 0;
     bool bol = true;
     int nest = 0;
-    struct token *t0 = lex();
-    lines++;
-    cc_assert(IS_NEWLINE(t0) || t0->id == EOI);
     for (;;) {
         // skip spaces
         skip_spaces();
@@ -634,7 +725,7 @@ void skip_ifstub(void)
             break;
         if (isnewline(ch)) {
             bol = true;
-            lines++;
+            (*lines)++;
             continue;
         }
         if (ch == '\'' || ch == '"') {
@@ -653,7 +744,7 @@ void skip_ifstub(void)
         if (t->id != ID) {
             if (IS_NEWLINE(t)) {
                 bol = true;
-                lines++;
+                (*lines)++;
             } else {
                 bol = false;
             }
@@ -683,19 +774,118 @@ void skip_ifstub(void)
         }
         skipline(false);
     }
+}
+
+static void skip_cached_group(struct file *fs, unsigned *lines)
+{
+    /* Skip part of conditional group in cached tokens.
+     */
+    struct vector *v = fs->cache;
+    int nest = 0;
+    size_t i;
+    for (i = fs->cachep; i < vec_len(v); i++) {
+        struct token *t = vec_at(v, i);
+        if (t->id != '#' || !t->bol)
+            continue;
+        size_t j = i + 1;
+        while (j < vec_len(v) && IS_SPACE(vec_at(v, j)))
+            j++;
+        struct token *t1 = vec_at_safe(v, j);
+        if (t1 == NULL || t1->id != ID)
+            continue;
+        const char *name = t1->name;
+        if (!strcmp(name, "if") || !strcmp(name, "ifdef")
+            || !strcmp(name, "ifndef")) {
+            nest++;
+        } else if (!nest &&
+                   (!strcmp(name, "elif") || !strcmp(name, "else")
+                    || !strcmp(name, "endif"))) {
+            // found
+            break;
+        } else if (nest && !strcmp(name, "endif")) {
+            nest--;
+        }
+    }
+    fs->cachep = i;
+    struct token *t = i < vec_len(v) ? vec_at(v, i) : vec_tail(v);
+    if (t) {
+        *lines += t->src.line - fs->line;
+        fs->line = t->src.line;
+        fs->column = t->src.column;
+    }
+}
+
+void skip_ifstub(void)
+{
+    /* Skip part of conditional group.
+     */
+    struct file *fs = current_file();
+    unsigned lines = 0;
+    struct token *t0 = lex();
+    lines++;
+    cc_assert(IS_NEWLINE(t0) || t0->id == EOI);
+    double start = opts.fmacro_stats ? wall_time() : 0;
+    bool lexed = false;                // counted by lex()
+    if (vec_len(fs->buffer)) {
+        skip_group_tokens(&lines);
+        lexed = true;
+    } else if (fs->cache) {
+        skip_cached_group(fs, &lines);
+    } else if (fs->buf && fs->charp == 0) {
+        struct source src;
+        const char *name = skip_rawgroup(&src, &lines);
+        if (name) {
+            // found
+            unget(new_token(&(struct token){.id = ID,.name = name,.src = src}));
+            unget(new_token(&(struct token){.id = '#',.src = src,.bol = true}));
+            BOL = false;
+        }
+    } else {
+        skip_group_tokens(&lines);
+        lexed = true;
+    }
+    if (opts.fmacro_stats && !lexed)
+        fs->lextime += wall_time() - start;
 
     while (lines-- > 0)
-        unget(newline_token);
+        unget(&newline_token);
+}
+
+/* Replay a cached token.
+ */
+static struct token *relex(struct file *fs)
+{
+    if (fs->cachep >= vec_len(fs->cache))
+        return &eoi_token;
+    struct token *t = vec_at(fs->cache, fs->cachep++);
+    fs->line = t->src.line;
+    fs->column = t->src.column;
+    if (IS_NEWLINE(t)) {
+        BOL = true;
+        newline_token.src = t->src;
+        return &newline_token;
+    } else if (IS_SPACE(t)) {
+        space_token.src = t->src;
+        return &space_token;
+    }
+    BOL = false;
+    // tokens are modified by the preprocessor and parser
+    return new_token(t);
 }
 
 struct token *lex(void)
 {
-    struct vector *v = current_file()->buffer;
+    struct file *fs = current_file();
     struct token *t;
-    if (vec_len(v))
-        t = vec_pop(v);
-    else
-        t = dolex();
+    if (vec_len(fs->buffer)) {
+        t = vec_pop(fs->buffer);
+    } else if (opts.fmacro_stats) {
+        double start = wall_time();
+        t = fs->cache ? relex(fs) : dolex();
+        fs->lextime += wall_time() - start;
+    } else {
+        t = fs->cache ? relex(fs) : dolex();
+    }
     mark(t);
     return t;
 }
@@ -770,7 +960,8 @@ static struct token *combine_scons(struct vector *v, bool wide)
             strbuf_cats(s, name);
     }
     strbuf_catc(s, '"');
-    t->name = strbuf_str(s);
+    t->name = strs(s->str);
+    strbuf_free(s);
     return t;
 }
 
@@ -825,8 +1016,9 @@ static int kwi[] = {
 #include "token.def"
 };
 
-struct token *token;
-struct token *ahead_token;
+THREAD_LOCAL struct token *token;
+THREAD_LOCAL struct token *ahead_token;
+static THREAD_LOCAL struct vector *replay;   // tokens to read again, top first
 
 static int tkind(int t)
 {
@@ -840,17 +1032,42 @@ static int tkind(int t)
         return 0;
 }
 
+static struct ident *new_ident(const char *name)
+{
+    struct ident *id = ralloc(REGION_TU, sizeof(struct ident));
+    strs_set_info(name, id);
+    return id;
+}
+
+// 'name' must be interned
+struct ident *ident(const char *name)
+{
+    static THREAD_LOCAL bool keywords;
+    struct ident *id = strs_info(name);
+    if (id)
+        return id;
+
+    if (!keywords) {
+        keywords = true;
+        for (int i = 0; i < ARRAY_SIZE(kws); i++)
+            new_ident(strs(kws[i]))->keyword = kwi[i];
+        if ((id = strs_info(name)))
+            return id;
+    }
+    return new_ident(name);
+}
+
 static struct token *cctoken(void)
 {
+    if (replay && vec_len(replay))
+        return vec_pop(replay);
+
     struct token *t = do_cctoken();
     // keywords
     if (t->id == ID) {
-        for (int i = 0; i < ARRAY_SIZE(kws); i++) {
-            if (!strcmp(t->name, kws[i])) {
-                t->id = kwi[i];
-                break;
-            }
-        }
+        int keyword = ident(t->name)->keyword;
+        if (keyword)
+            t->id = keyword;
     }
     // set kind finally
     t->kind = tkind(t->id);
@@ -879,6 +1096,24 @@ struct token *lookahead(void)
     return ahead_token;
 }
 
+/**
+ * Parse the tokens of 'v', which were read before, and
+ * then the current token again.
+ */
+void unread_tokens(struct vector *v)
+{
+    if (replay == NULL)
+        replay = vec_new();
+    if (ahead_token) {
+        vec_push(replay, ahead_token);
+        ahead_token = NULL;
+    }
+    vec_push(replay, token);
+    for (int i = vec_len(v) - 1; i >= 0; i--)
+        vec_push(replay, vec_at(v, i));
+    gettok();
+}
+
 void expect(int t)
 {
     if (token->id == t)
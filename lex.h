@@ -39,6 +39,11 @@ struct file {
     struct cc_char chars[MAX_UNREADC];        // readc ungets
     struct vector *buffer;        // lex ungets
     struct vector *tokens;        // parser ungets
+    struct vector *cache;        // cached raw tokens
+    size_t cachep;                // next cached token
+    struct pch *pch;                // precompiled header
+    struct header *header;        // included header
+    double lextime;                // seconds spent lexing
 };
 
 struct ifstub {
@@ -56,6 +61,7 @@ extern void unreadc(int c);
 extern struct file *with_string(const char *input, const char *name);
 extern struct file *with_file(const char *file, const char *name);
 extern struct file *with_buffer(struct vector *v);
+extern struct file *with_tokens(struct vector *v, const char *name);
 
 extern void file_sentinel(struct file *f);
 extern void file_unsentinel(void);
@@ -67,6 +73,7 @@ extern void if_sentinel(struct ifstub *i);
 extern void if_unsentinel(void);
 extern struct ifstub *new_ifstub(struct ifstub *i);
 extern struct ifstub *current_ifstub(void);
+extern const char *skip_rawgroup(struct source *src, unsigned *lines);
 
 enum {
 #define _a(a, b, c)     a,
@@ -111,13 +118,37 @@ struct macro {
 extern void cpp_init(struct vector *options);
 extern struct token *get_pptok(void);
 extern struct vector *all_pptoks(void);
+extern void emit_pch(FILE *fp);
+extern void print_macro_stats(void);
+
+// pch.c
+struct pch;
+extern void write_pch(FILE *fp, const char *config, struct vector *tokens,
+                      struct vector *names, struct vector *macros);
+extern struct pch *open_pch(const char *file);
+extern void close_pch(struct pch *pch);
+extern const char *pch_config(struct pch *pch);
+extern void pch_define(struct pch *pch,
+                       void (*define) (const char *name, struct macro *m));
+extern struct token *pch_token(struct pch *pch);
 
 // lex.c
-extern struct source source;
-extern struct token *token;
-extern struct token *ahead_token;
-extern struct token *newline_token;
-extern struct token *space_token;
+/* What an identifier currently stands for, attached to its
+ * interned name so that each is a pointer dereference away.
+ */
+struct binding;
+struct ident {
+    struct macro *macro;            // the macro definition
+    int keyword;                    // the keyword id, 0 if none
+    struct binding *bindings[3];    // innermost binding per table
+};
+
+extern struct ident *ident(const char *name);
+extern THREAD_LOCAL struct source source;
+extern THREAD_LOCAL struct token *token;
+extern THREAD_LOCAL struct token *ahead_token;
+extern THREAD_LOCAL struct token newline_token;
+extern THREAD_LOCAL struct token space_token;
 
 extern int isletter(int c);
 extern int isxalpha(int c);
@@ -129,11 +160,13 @@ extern int isxalpha(int c);
 extern struct token *lex(void);
 extern void unget(struct token *t);
 extern struct token *header_name(void);
+extern struct vector *tokenize(const char *file, const char *name);
 extern struct token *new_token(struct token *tok);
 extern void skip_ifstub(void);
 
 extern int gettok(void);
 extern struct token *lookahead(void);
+extern void unread_tokens(struct vector *v);
 extern void expect(int t);
 extern void match(int t, int follow[]);
 extern int skipto(int (*test[]) (struct token *));
@@ -34,8 +34,12 @@ static void usage(void)
             "  -Dname=value    Define a macro\n"
             "  -Uname          Undefine a macro\n"
             "  -E              Only run the preprocessor\n"
+            "  -fmacro-stats   Report the most expensive macros and headers\n"
+            "  --emit-pch      Generate a precompiled header from the input\n"
             "  -h, --help      Display available options\n"
             "  -Idir           Add dir to include search path\n"
+            "  -include-pch <file>\n"
+            "                  Include precompiled header <file>\n"
             "  -lx             Search for library x\n"
             "  -Ldir           Add dir to library search path\n"
             "  -o <file>       Write output to <file>\n"
@@ -77,6 +81,15 @@ static void parse_opts(int argc, char *argv[])
                 opts.E = true;
             } else if (!strcmp(arg, "-S")) {
                 opts.S = true;
+            } else if (!strcmp(arg, "-fmacro-stats")) {
+                opts.fmacro_stats = true;
+            } else if (!strcmp(arg, "--emit-pch")) {
+                opts.emit_pch = true;
+            } else if (!strcmp(arg, "-include-pch")) {
+                if (++i >= argc)
+                    die("missing file name after '-include-pch'");
+                vec_push(opts.cpp_options, arg);
+                vec_push(opts.cpp_options, argv[i]);
             } else if (!strcmp(arg, "-h") ||
                        !strcmp(arg, "--help") ||
                        !strcmp(arg, "-v") ||
@@ -190,7 +203,8 @@ int main(int argc, char **argv)
     init_env();
     parse_opts(argc, argv);
 
-    bool partial = opts.E || opts.ast_dump || opts.ir_dump || opts.S || opts.c;
+    bool partial = opts.E || opts.ast_dump || opts.ir_dump || opts.S ||
+        opts.c || opts.emit_pch;
 
     if (argc == 1) {
         usage();
@@ -214,7 +228,13 @@ int main(int argc, char **argv)
         const char *iname = basename(xstrdup(ifile));
         const char *ofile = NULL;
         int ret;
-        if (opts.E || opts.ast_dump || opts.ir_dump) {
+        if (opts.emit_pch) {
+            if (output)
+                ofile = output;
+            else
+                ofile = format("%s.pch", iname);
+            ret = translate(ifile, ofile);
+        } else if (opts.E || opts.ast_dump || opts.ir_dump) {
             if (output)
                 ofile = output;
             ret = translate(ifile, ofile);
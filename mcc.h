@@ -80,6 +80,8 @@ struct options {
     int fleading_underscore:1;
     int Wall:1;
     int Werror:1;
+    int emit_pch:1;
+    int fmacro_stats:1;
     struct vector *cpp_options;
     struct vector *ld_options;
 };
@@ -0,0 +1,334 @@
+#include "cc.h"
+#include "sys/sys.h"
+
+/* Precompiled header
+ *
+ * A precompiled header is the state of the preprocessor at the
+ * end of a prefix header: the macro table, and the expanded
+ * token stream the parser reads from it. The file refers to
+ * strings and tokens by index only, so it's position-independent
+ * and is used in place after mmap.
+ *
+ * It is only valid with the options it was built with: the
+ * predefined macros and the -D, -U and -I options, kept as one
+ * string.
+ *
+ * Layout:
+ *
+ *   struct pch_header
+ *   uint32_t         strings[nstrs]    offsets into string data
+ *   struct pch_token tokens[ntoks]     stream first, then macros
+ *   struct pch_macro macros[nmacros]
+ *   char             data[datasize]    NUL-terminated strings
+ */
+
+#define PCH_MAGIC      "MCCPCH"
+#define PCH_VERSION    2
+
+struct pch_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t nstrs;
+    uint32_t ntoks;
+    uint32_t nstream;
+    uint32_t nmacros;
+    uint32_t datasize;
+    uint32_t config;            // the options, string index
+};
+
+struct pch_token {
+    int16_t id;
+    int16_t kind;
+    uint8_t bol;
+    uint8_t space;
+    uint16_t pad;
+    uint32_t name;
+    uint32_t file;
+    uint32_t line;
+    uint32_t column;
+};
+
+struct pch_macro {
+    uint32_t name;
+    uint8_t kind;
+    uint8_t vararg;
+    uint8_t builtin;
+    uint8_t pad;
+    uint32_t params;
+    uint32_t nparams;
+    uint32_t body;
+    uint32_t nbody;
+    uint32_t file;
+    uint32_t line;
+    uint32_t column;
+};
+
+struct pch {
+    void *addr;
+    size_t size;
+    const struct pch_header *header;
+    const struct pch_token *tokens;
+    const struct pch_macro *macros;
+    const char **strings;        // interned
+    uint32_t next;                // next stream token
+};
+
+static THREAD_LOCAL struct token pch_eoi = {.id = EOI,.name = "EOI" };
+
+/* Writing
+ */
+struct pch_writer {
+    struct map *index;
+    struct vector *strings;
+    struct strbuf *data;
+    struct pch_token *tokens;
+    uint32_t ntoks;
+};
+
+static uint32_t pch_string(struct pch_writer *w, const char *s)
+{
+    // index 0 is NULL
+    if (s == NULL)
+        return 0;
+    uint32_t i = (uintptr_t) map_get(w->index, s);
+    if (i == 0) {
+        vec_push(w->strings, (char *)s);
+        i = vec_len(w->strings);
+        map_put(w->index, s, (void *)(uintptr_t) i);
+    }
+    return i;
+}
+
+static void pch_write_token(struct pch_writer *w, struct token *t)
+{
+    struct pch_token *p = &w->tokens[w->ntoks++];
+    p->id = t->id;
+    p->kind = t->kind;
+    p->bol = t->bol;
+    p->space = t->space;
+    p->name = pch_string(w, t->name);
+    p->file = pch_string(w, t->src.file);
+    p->line = t->src.line;
+    p->column = t->src.column;
+}
+
+void write_pch(FILE *fp, const char *config, struct vector *tokens,
+               struct vector *names, struct vector *macros)
+{
+    struct pch_writer w = {
+        .index = map_new(),
+        .strings = vec_new(),
+        .data = strbuf_new()
+    };
+    size_t ntoks = vec_len(tokens);
+    size_t nmacros = vec_len(macros);
+    for (int i = 0; i < nmacros; i++) {
+        struct macro *m = vec_at(macros, i);
+        ntoks += vec_len(m->params) + vec_len(m->body);
+    }
+    w.tokens = xcalloc(ntoks, sizeof(struct pch_token));
+
+    for (int i = 0; i < vec_len(tokens); i++)
+        pch_write_token(&w, vec_at(tokens, i));
+
+    struct pch_macro *pm = xcalloc(nmacros, sizeof(struct pch_macro));
+    for (int i = 0; i < nmacros; i++) {
+        struct macro *m = vec_at(macros, i);
+        struct pch_macro *p = &pm[i];
+        p->name = pch_string(&w, vec_at(names, i));
+        p->kind = m->kind;
+        p->vararg = m->vararg;
+        p->builtin = m->builtin;
+        p->params = w.ntoks;
+        p->nparams = vec_len(m->params);
+        for (int j = 0; j < vec_len(m->params); j++)
+            pch_write_token(&w, vec_at(m->params, j));
+        p->body = w.ntoks;
+        p->nbody = vec_len(m->body);
+        for (int j = 0; j < vec_len(m->body); j++)
+            pch_write_token(&w, vec_at(m->body, j));
+        p->file = pch_string(&w, m->src.file);
+        p->line = m->src.line;
+        p->column = m->src.column;
+    }
+    uint32_t iconfig = pch_string(&w, config);
+
+    size_t nstrs = vec_len(w.strings) + 1;
+    uint32_t *offsets = xcalloc(nstrs, sizeof(uint32_t));
+    for (int i = 1; i < nstrs; i++) {
+        offsets[i] = strbuf_len(w.data);
+        const char *s = vec_at(w.strings, i - 1);
+        strbuf_catn(w.data, s, strlen(s) + 1);
+    }
+
+    struct pch_header h = {
+        .magic = PCH_MAGIC,
+        .version = PCH_VERSION,
+        .nstrs = nstrs,
+        .ntoks = w.ntoks,
+        .nstream = vec_len(tokens),
+        .nmacros = nmacros,
+        .datasize = strbuf_len(w.data),
+        .config = iconfig
+    };
+    fwrite(&h, sizeof h, 1, fp);
+    fwrite(offsets, sizeof(uint32_t), nstrs, fp);
+    fwrite(w.tokens, sizeof(struct pch_token), w.ntoks, fp);
+    fwrite(pm, sizeof(struct pch_macro), nmacros, fp);
+    fwrite(w.data->str, 1, h.datasize, fp);
+
+    free(offsets);
+    free(pm);
+    free(w.tokens);
+    strbuf_free(w.data);
+    vec_free(w.strings);
+    map_free(w.index);
+}
+
+/* Reading
+ */
+static bool pch_valid(struct pch *pch)
+{
+    const struct pch_header *h = pch->header;
+    if (pch->size < sizeof *h ||
+        memcmp(h->magic, PCH_MAGIC, sizeof PCH_MAGIC) ||
+        h->version != PCH_VERSION)
+        return false;
+
+    uint64_t size = sizeof *h +
+        (uint64_t) h->nstrs * sizeof(uint32_t) +
+        (uint64_t) h->ntoks * sizeof(struct pch_token) +
+        (uint64_t) h->nmacros * sizeof(struct pch_macro) + h->datasize;
+    if (size != pch->size || h->nstrs == 0 || h->nstream > h->ntoks ||
+        h->config >= h->nstrs)
+        return false;
+
+    // the string data must end with NUL
+    const char *data = (const char *)pch->addr + pch->size - h->datasize;
+    return h->datasize == 0 || data[h->datasize - 1] == '\0';
+}
+
+struct pch *open_pch(const char *file)
+{
+    size_t size;
+    void *addr = map_file(file, &size);
+    if (addr == NULL)
+        return NULL;
+
+    struct pch *pch = zmalloc(sizeof(struct pch));
+    pch->addr = addr;
+    pch->size = size;
+    pch->header = addr;
+    if (!pch_valid(pch)) {
+        close_pch(pch);
+        return NULL;
+    }
+
+    const struct pch_header *h = pch->header;
+    const uint32_t *offsets = (const uint32_t *)(h + 1);
+    pch->tokens = (const struct pch_token *)(offsets + h->nstrs);
+    pch->macros = (const struct pch_macro *)(pch->tokens + h->ntoks);
+    const char *data = (const char *)(pch->macros + h->nmacros);
+
+    pch->strings = zmalloc(h->nstrs * sizeof(char *));
+    for (uint32_t i = 1; i < h->nstrs; i++) {
+        if (offsets[i] >= h->datasize) {
+            close_pch(pch);
+            return NULL;
+        }
+        pch->strings[i] = strs(data + offsets[i]);
+    }
+
+    // every reference must be in range
+    for (uint32_t i = 0; i < h->ntoks; i++) {
+        const struct pch_token *p = &pch->tokens[i];
+        if (p->name >= h->nstrs || p->file >= h->nstrs) {
+            close_pch(pch);
+            return NULL;
+        }
+    }
+    for (uint32_t i = 0; i < h->nmacros; i++) {
+        const struct pch_macro *p = &pch->macros[i];
+        if (p->name == 0 || p->name >= h->nstrs || p->file >= h->nstrs ||
+            (uint64_t) p->params + p->nparams > h->ntoks ||
+            (uint64_t) p->body + p->nbody > h->ntoks) {
+            close_pch(pch);
+            return NULL;
+        }
+    }
+
+    return pch;
+}
+
+void close_pch(struct pch *pch)
+{
+    unmap_file(pch->addr, pch->size);
+    free(pch->strings);
+    free(pch);
+}
+
+// The options the precompiled header was built with.
+const char *pch_config(struct pch *pch)
+{
+    return pch->strings[pch->header->config];
+}
+
+static struct token *pch_read_token(struct pch *pch, uint32_t i,
+                                    struct token *t)
+{
+    const struct pch_token *p = &pch->tokens[i];
+    t->id = p->id;
+    t->kind = p->kind;
+    t->bol = p->bol;
+    t->space = p->space;
+    t->name = pch->strings[p->name];
+    t->src.file = pch->strings[p->file];
+    t->src.line = p->line;
+    t->src.column = p->column;
+    t->hideset = NULL;
+    return t;
+}
+
+static struct vector *pch_read_tokens(struct pch *pch, uint32_t i, uint32_t n)
+{
+    struct vector *v = vec_new();
+    for (uint32_t j = 0; j < n; j++)
+        vec_push(v, pch_read_token(pch, i + j, alloc_token()));
+    return v;
+}
+
+// Define the macros of the precompiled header.
+void pch_define(struct pch *pch,
+                void (*define) (const char *name, struct macro *m))
+{
+    for (uint32_t i = 0; i < pch->header->nmacros; i++) {
+        const struct pch_macro *p = &pch->macros[i];
+        struct macro *m = alloc_macro();
+        m->kind = p->kind;
+        m->vararg = p->vararg;
+        m->builtin = p->builtin;
+        m->params = pch_read_tokens(pch, p->params, p->nparams);
+        m->body = pch_read_tokens(pch, p->body, p->nbody);
+        m->src.file = pch->strings[p->file];
+        m->src.line = p->line;
+        m->src.column = p->column;
+        define(pch->strings[p->name], m);
+    }
+}
+
+// Next token of the expanded stream, EOI at the end.
+struct token *pch_token(struct pch *pch)
+{
+    if (pch->next >= pch->header->nstream)
+        return &pch_eoi;
+
+    const struct pch_token *p = &pch->tokens[pch->next];
+    struct token *t;
+    if (p->id == ' ')
+        t = &space_token;
+    else if (p->id == '\n')
+        t = &newline_token;
+    else
+        t = alloc_token();
+    return pch_read_token(pch, pch->next++, t);
+}
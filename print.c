@@ -151,8 +151,12 @@ static void print_expr(node_t * node, struct print_context context)
         putf(CYAN("%s "), STR(SYM_NAME(EXPR_SYM(node))));
     if (op == INCR || op == DECR)
         putf("%s ", (prefix ? "prefix" : "postfix"));
-    if (op > 0)
+    if (AST_ID(node) == VINIT_EXPR) {
+        if (EXPR_VINIT_LEN(node) > 1)
+            putf("x%d ", EXPR_VINIT_LEN(node));
+    } else if (op > 0) {
         putf("'%s' ", id2s(op));
+    }
     if (AST_NAME(node))
         putf("<" RED("%s") "> ", AST_NAME(node));
     if (isiliteral(node)) {
@@ -405,20 +409,33 @@ void print_tree(node_t * tree)
     print_tree1(context);
 }
 
+// temporaries and labels are numbered
+static const char * sym_label(node_t *sym)
+{
+    switch (SYM_X_KIND(sym)) {
+    case SYM_KIND_TMP:
+        return format(".t%llu", SYM_VALUE_U(sym));
+    case SYM_KIND_LABEL:
+        return format(".L%llu", SYM_VALUE_U(sym));
+    default:
+        return SYM_X_LABEL(sym);
+    }
+}
+
 static const char * operand2s(struct operand *operand)
 {
     switch (operand->op) {
     case IR_SUBSCRIPT:
         return format("%s[%s]",
-                      SYM_X_LABEL(operand->sym),
-                      SYM_X_LABEL(operand->index));
+                      sym_label(operand->sym),
+                      sym_label(operand->index));
     case IR_INDIRECTION:
-        return format("*%s", SYM_X_LABEL(operand->sym));
+        return format("*%s", sym_label(operand->sym));
     case IR_ADDRESS:
-        return format("&%s", SYM_X_LABEL(operand->sym));
+        return format("&%s", sym_label(operand->sym));
     case IR_NONE:
     default:
-        return SYM_X_LABEL(operand->sym);
+        return sym_label(operand->sym);
     }
 }
 
@@ -446,11 +463,13 @@ void print_tac(struct tac *tac)
     case IR_IF_FALSE_I:
     case IR_IF_FALSE_F:
         if (tac->relop) {
-            // rel if
-            putf("%s %s %s %s %s %s",
+            // rel if, an unsigned integer order test is '<u'
+            bool u = (tac->op == IR_IF_I || tac->op == IR_IF_FALSE_I) &&
+                !tac->sign && tac->relop != EQ && tac->relop != NEQ;
+            putf("%s %s %s%s %s %s %s",
                   rop2s(tac->op),
                   operand2s(tac->args[0]),
-                  id2s(tac->relop),
+                  id2s(tac->relop), u ? "u" : "",
                   operand2s(tac->args[1]),
                   rop2s(IR_GOTO),
                   operand2s(tac->result));
@@ -5,11 +5,60 @@ static node_t *compound_stmt(void (*) (void));
 static node_t ** filter_decls(node_t **decls);
 static void filter_unused(void);
 
-static node_t *__loop;
-static node_t *__switch;
-static struct vector *__cases;
-static node_t *__default;
-static node_t *__switch_ty;
+static THREAD_LOCAL node_t *__loop;
+static THREAD_LOCAL node_t *__switch;
+static THREAD_LOCAL struct map *__cases;
+static THREAD_LOCAL node_t *__default;
+static THREAD_LOCAL node_t *__switch_ty;
+
+/* The cases of a switch are kept in a map keyed by their
+ * value, which finds a duplicate in one probe. The IR gets
+ * them sorted by value.
+ */
+static unsigned case_hash(const void *key)
+{
+    unsigned long long i = STMT_CASE_INDEX((node_t *) key);
+    return i * 0x9E3779B97F4A7C15ull >> 32;
+}
+
+static int case_cmp(const void *key1, const void *key2)
+{
+    return STMT_CASE_INDEX((node_t *) key1) != STMT_CASE_INDEX((node_t *) key2);
+}
+
+static struct map *new_cases(void)
+{
+    struct map *map = map_new();
+    map->hashfn = case_hash;
+    map->cmpfn = case_cmp;
+    return map;
+}
+
+static int signed_case_cmp(const void *a, const void *b)
+{
+    long i1 = STMT_CASE_INDEX(*(node_t **) a);
+    long i2 = STMT_CASE_INDEX(*(node_t **) b);
+    return (i1 > i2) - (i1 < i2);
+}
+
+static int unsigned_case_cmp(const void *a, const void *b)
+{
+    unsigned long i1 = STMT_CASE_INDEX(*(node_t **) a);
+    unsigned long i2 = STMT_CASE_INDEX(*(node_t **) b);
+    return (i1 > i2) - (i1 < i2);
+}
+
+// the cases in the order of their values in type 'ty'
+static node_t **sorted_cases(struct map *cases, node_t *ty)
+{
+    struct vector *v = map_values(cases);
+    bool issigned = !ty || TYPE_OP(ty) == INT;
+    qsort(v->mem, vec_len(v), sizeof(void *),
+          issigned ? signed_case_cmp : unsigned_case_cmp);
+    node_t **list = (node_t **) vtoa(v);
+    vec_free(v);
+    return list;
+}
 
 #define SET_LOOP_CONTEXT(loop)                  \
     node_t *__saved_loop = __loop;              \
@@ -20,16 +69,16 @@ static node_t *__switch_ty;
 
 #define SET_SWITCH_CONTEXT(sw, ty)              \
     node_t *__saved_sw = __switch;              \
-    struct vector *__saved_cases = __cases;     \
+    struct map *__saved_cases = __cases;        \
     node_t *__saved_default = __default;        \
     node_t *__saved_switch_ty = __switch_ty;    \
     __switch = sw;                              \
-    __cases = vec_new();                        \
+    __cases = new_cases();                      \
     __default = NULL;                           \
     __switch_ty = ty
 
 #define RESTORE_SWITCH_CONTEXT()                \
-    vec_free(__cases);                          \
+    map_free(__cases);                          \
     __switch = __saved_sw;                      \
     __cases = __saved_cases;                    \
     __default = __saved_default;                \
@@ -42,14 +91,14 @@ static node_t *__switch_ty;
 #define SWITCH_TYPE   (__switch_ty)
 
 // funcdef context
-struct vector *funcalls;
-static struct vector *gotos;
-static struct map *labels;
-static node_t *functype;
-static const char *funcname;
-static struct vector *staticvars;
-static struct vector *localvars;
-static struct vector *allvars;
+THREAD_LOCAL struct vector *funcalls;
+static THREAD_LOCAL struct vector *gotos;
+static THREAD_LOCAL struct map *labels;
+static THREAD_LOCAL node_t *functype;
+static THREAD_LOCAL const char *funcname;
+static THREAD_LOCAL struct vector *staticvars;
+static THREAD_LOCAL struct vector *localvars;
+static THREAD_LOCAL struct vector *allvars;
 
 static node_t *expr_stmt(void)
 {
@@ -58,7 +107,7 @@ static node_t *expr_stmt(void)
     if (token->id == ';')
         ret = ast_stmt(NULL_STMT, source);
     else if (first_expr(token))
-        ret = reduce(expression());
+        ret = expression();
     else
         error("missing statement before '%s'", token->name);
 
@@ -254,7 +303,7 @@ static node_t *switch_stmt(void)
     if (NO_ERROR) {
         STMT_SWITCH_EXPR(ret) = expr;
         STMT_SWITCH_BODY(ret) = body;
-        STMT_SWITCH_CASES(ret) = (node_t **) vtoa(CASES);
+        STMT_SWITCH_CASES(ret) = sorted_cases(CASES, SWITCH_TYPE);
         STMT_SWITCH_DEFAULT(ret) = DEFLT;
     } else {
         ret = NULL;
@@ -265,21 +314,20 @@ static node_t *switch_stmt(void)
     return ret;
 }
 
-static void check_case_duplicates(node_t * node)
+static void add_case(node_t * node)
 {
-    for (int i = vec_len(CASES) - 1; i >= 0; i--) {
-        node_t *n = vec_at(CASES, i);
-        if (STMT_CASE_INDEX(n) == STMT_CASE_INDEX(node)) {
-            errorf(AST_SRC(node),
-                   "duplicate case value '%lld', "
-                   "previous case defined here: %s:%u:%u",
-                   STMT_CASE_INDEX(node),
-                   AST_SRC(n).file,
-                   AST_SRC(n).line,
-                   AST_SRC(n).column);
-            break;
-        }
+    node_t *n = map_get(CASES, node);
+    if (n) {
+        errorf(AST_SRC(node),
+               "duplicate case value '%lld', "
+               "previous case defined here: %s:%u:%u",
+               STMT_CASE_INDEX(node),
+               AST_SRC(n).file,
+               AST_SRC(n).line,
+               AST_SRC(n).column);
+        return;
     }
+    map_put(CASES, node, node);
 }
 
 static node_t *case_stmt(void)
@@ -297,8 +345,7 @@ static node_t *case_stmt(void)
 
     // only check when intexpr is okay.
     if (NO_ERROR) {
-        check_case_duplicates(ret);
-        vec_push(CASES, ret);
+        add_case(ret);
     }
 
     // always parse even if not in a switch statement
@@ -583,7 +630,7 @@ static void backfill_labels(void)
 static void set_funcdef_context(node_t *fty, const char *name)
 {
     gotos = vec_new();
-    labels = map_new();
+    labels = ptrmap_new();
     functype = fty;
     funcname = name;
     staticvars = vec_new();
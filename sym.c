@@ -1,31 +1,91 @@
 #include "cc.h"
 
-struct table *identifiers;
-struct table *constants;
-struct table *tags;
-
-static int level = GLOBAL;
-
-struct table *new_table(struct table *up, int scope)
+/* Symbol tables
+ *
+ * The innermost binding of a name in each table hangs off the
+ * name's struct ident, the bindings of the same name are
+ * chained from the inner to the outer scope. All bindings of
+ * a table are also kept on a stack ordered by scope, so
+ * leaving a scope pops exactly those it introduced and
+ * restores what they shadowed.
+ */
+struct binding {
+    node_t *sym;
+    int scope;
+    unsigned gen;               // generation of a global binding
+    struct binding *shadow;     // outer binding of the same name
+    struct binding *link;       // next binding on the stack
+};
+
+THREAD_LOCAL struct table *identifiers;
+THREAD_LOCAL struct table *constants;
+THREAD_LOCAL struct table *tags;
+
+static THREAD_LOCAL int level = GLOBAL;
+static THREAD_LOCAL struct binding *free_bindings;
+
+/* Generations
+ *
+ * Skipped static inline bodies (see decl.c) are parsed at
+ * the end of the unit, but must resolve names the way they
+ * would have where they were written. Skipping a body
+ * starts a new generation. Global bindings and tag
+ * definitions record the generation they were made in, and
+ * while a skipped body is parsed everything from its
+ * generation on is hidden.
+ */
+static THREAD_LOCAL unsigned generation;
+static THREAD_LOCAL unsigned horizon;   // 0 if nothing is hidden
+
+static struct table *new_table(void)
 {
+    static THREAD_LOCAL int index;
+    cc_assert(index < ARRAY_SIZE(((struct ident *)0)->bindings));
     struct table *t = zmalloc(sizeof(struct table));
-    t->up = up;
-    t->scope = scope;
-    t->map = map_new();
+    t->index = index++;
     return t;
 }
 
-void free_table(struct table *t)
+#define BINDING(name, t)    (ident(name)->bindings[(t)->index])
+
+static struct binding *new_binding(void)
 {
-    map_free(t->map);
-    free(t);
+    struct binding *b = free_bindings;
+    if (b)
+        free_bindings = b->link;
+    else
+        b = xmalloc(sizeof(struct binding));
+    return b;
+}
+
+// pop the bindings of the scopes from 'scope' in
+static void pop_bindings(struct table *t, int scope)
+{
+    while (t->top && t->top->scope >= scope) {
+        struct binding *b = t->top;
+        const char *name = SYM_NAME(b->sym);
+        cc_assert(BINDING(name, t) == b);
+        BINDING(name, t) = b->shadow;
+        t->top = b->link;
+        b->link = free_bindings;
+        free_bindings = b;
+    }
 }
 
 void symbol_init(void)
 {
-    identifiers = new_table(NULL, GLOBAL);
-    constants = new_table(NULL, CONSTANT);
-    tags = new_table(NULL, GLOBAL);
+    // the slots of struct ident are reused by each unit of a thread
+    if (identifiers) {
+        pop_bindings(identifiers, CONSTANT);
+        pop_bindings(constants, CONSTANT);
+        pop_bindings(tags, CONSTANT);
+    } else {
+        identifiers = new_table();
+        constants = new_table();
+        tags = new_table();
+    }
+    level = GLOBAL;
+    generation = horizon = 0;
 }
 
 int scopelevel(void)
@@ -40,16 +100,8 @@ void enter_scope(void)
 
 void exit_scope(void)
 {
-    if (tags->scope == level) {
-        struct table *up = tags->up;
-        free_table(tags);
-        tags = up;
-    }
-    if (identifiers->scope == level) {
-        struct table *up = identifiers->up;
-        free_table(identifiers);
-        identifiers = up;
-    }
+    pop_bindings(tags, level);
+    pop_bindings(identifiers, level);
     cc_assert(level >= GLOBAL);
     level--;
 }
@@ -64,44 +116,94 @@ bool is_anonymous(const char *name)
     return name == NULL || !isletter(name[0]);
 }
 
-node_t *anonymous(struct table **tpp, int scope)
+node_t *anonymous(struct table *table, int scope)
 {
-    static long i;
-    return install(strs(format("@%ld", i++)), tpp, scope);
+    static THREAD_LOCAL long i;
+    return install(strs(format("@%ld", i++)), table, scope);
 }
 
-node_t *lookup(const char *name, struct table * table)
+unsigned new_generation(void)
 {
-    cc_assert(name);
-    node_t *s = NULL;
+    return ++generation;
+}
 
-    for (struct table * t = table; t; t = t->up) {
-        if ((s = map_get(t->map, name)))
-            return s;
-    }
+// what a skipped body declares itself is never hidden
+unsigned current_generation(void)
+{
+    return horizon ? 0 : generation;
+}
 
-    return s;
+void hide_generations(unsigned gen)
+{
+    horizon = gen;
 }
 
-node_t *install(const char *name, struct table ** tpp, int scope)
+bool is_hidden(unsigned gen)
 {
-    node_t *sym;
-    struct table *tp = *tpp;
+    return horizon && gen >= horizon;
+}
 
-    if (scope > tp->scope) {
-        tp = *tpp = new_table(tp, scope);
-    } else {
-        while (scope != tp->scope)
-            tp = tp->up;
-    }
+node_t *lookup(const char *name, struct table *table)
+{
+    cc_assert(name);
+    struct binding *b = BINDING(name, table);
+    while (b && is_hidden(b->gen))
+        b = b->shadow;
+    return b ? b->sym : NULL;
+}
 
-    cc_assert(tp);
+node_t *install(const char *name, struct table *table, int scope)
+{
+    cc_assert(scope <= level);
 
-    sym = alloc_symbol();
+    node_t *sym = alloc_symbol();
     SYM_SCOPE(sym) = scope;
     SYM_NAME(sym) = name;
     SYM_X_LABEL(sym) = name;
-    map_put(tp->map, name, sym);
+    bind(sym, table);
 
     return sym;
 }
+
+void bind(node_t *sym, struct table *table)
+{
+    const char *name = SYM_NAME(sym);
+    int scope = SYM_SCOPE(sym);
+    cc_assert(scope <= level);
+
+    // redeclared in the same scope
+    struct binding *head = BINDING(name, table);
+    if (head && head->scope == scope) {
+        head->sym = sym;
+        return;
+    }
+
+    struct binding *b = new_binding();
+    b->sym = sym;
+    b->scope = scope;
+    b->gen = scope == GLOBAL ? current_generation() : 0;
+
+    if (!head || head->scope < scope) {
+        b->shadow = head;
+        BINDING(name, table) = b;
+    } else {
+        // into an outer scope, below the inner bindings
+        struct binding *p = head;
+        while (p->shadow && p->shadow->scope > scope)
+            p = p->shadow;
+        if (p->shadow && p->shadow->scope == scope) {
+            p->shadow->sym = sym;
+            b->link = free_bindings;
+            free_bindings = b;
+            return;
+        }
+        b->shadow = p->shadow;
+        p->shadow = b;
+    }
+
+    struct binding **pp = &table->top;
+    while (*pp && (*pp)->scope > scope)
+        pp = &(*pp)->link;
+    b->link = *pp;
+    *pp = b;
+}
@@ -11,6 +11,8 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <time.h>
 // dirname, basename
 #include <libgen.h>
@@ -143,6 +145,38 @@ int file_size(const char *path)
         return -1;
 }
 
+time_t file_mtime(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0)
+        return st.st_mtime;
+    else
+        return -1;
+}
+
+void *map_file(const char *path, size_t *size)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return NULL;
+    *size = st.st_size;
+    return addr;
+}
+
+void unmap_file(void *addr, size_t size)
+{
+    munmap(addr, size);
+}
+
 int isdir(const char *path)
 {
     if (path == NULL)
@@ -153,6 +187,16 @@ int isdir(const char *path)
     return S_ISDIR(st.st_mode);
 }
 
+int isfile(const char *path)
+{
+    if (path == NULL)
+        return 0;
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+    return S_ISREG(st.st_mode);
+}
+
 int callsys(const char *file, char **argv)
 {
     pid_t pid;
@@ -290,3 +334,11 @@ void set_localtime(const time_t * timep, struct tm *result)
 {
     localtime_r(timep, result);
 }
+
+// monotonic time in seconds
+double wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
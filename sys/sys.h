@@ -7,7 +7,11 @@ extern void setup_sys();
 extern const char *mktmpdir();
 extern int file_exists(const char *path);
 extern int file_size(const char *path);
+extern time_t file_mtime(const char *path);
+extern void *map_file(const char *path, size_t *size);
+extern void unmap_file(void *addr, size_t size);
 extern int isdir(const char *path);
+extern int isfile(const char *path);
 extern int rmdir(const char *dir);
 extern const char *abspath(const char *path);
 extern const char *replace_suffix(const char *path, const char *suffix);
@@ -21,6 +25,7 @@ extern int runproc(int (*proc) (void *), void *context);
 
 // time
 extern void set_localtime(const time_t * timep, struct tm *result);
+extern double wall_time(void);
 
 extern char *ld[];
 extern char *as[];
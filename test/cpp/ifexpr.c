@@ -0,0 +1,30 @@
+#define X
+#define Y 1
+#if -1 < 0 && !(-1 < 0u)
+a
+#endif
+#if 0xffffffffffffffff == -1 && 18446744073709551615u == -1
+b
+#endif
+#if -9223372036854775807-1 < 0 && 8/-3 == -2 && -8%3 == -2
+c
+#endif
+#if (1 ? -1 : 0u) > 0
+d
+#endif
+#if 0 ? 1/0 : 1 || 1/0
+e
+#endif
+#if 0 && 1/0
+#else
+f
+#endif
+#if 1 ? 2 ? 3 : 4 : 5
+g
+#endif
+#if defined X && defined(Y) && !UNDEF
+h
+#endif
+#if 'a' == 97 && (-1) >> 1 == -1 && (1u << 63) > 0
+i
+#endif
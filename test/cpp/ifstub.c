@@ -0,0 +1,19 @@
+#if 0
+/* #endif
+ */
+"#endif /*"
+'"' #else
+#if 1
+#else
+#endif
+# /* */ ifdef A
+#endif
+#elif 1
+a
+#endif
+#ifdef B
+#error "b\
+#endif
+#else
+b
+#endif
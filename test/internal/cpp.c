@@ -0,0 +1,117 @@
+#include "internal.h"
+
+static int count(const char *str, const char *sub)
+{
+	int n = 0;
+	for (const char *p = str; (p = strstr(p, sub)); p += strlen(sub))
+		n++;
+	return n;
+}
+
+static const char *preprocess(const char *code)
+{
+	const char *out;
+
+	opts.E = true;
+	expecti(mcc_run(code, NULL, &out, NULL), EXIT_SUCCESS);
+	opts.E = false;
+	return out;
+}
+
+static void test_header_cache()
+{
+	const char *out;
+
+	write_file("l.h", "\nint h = __LINE__;");
+	write_file("g.h", "#ifndef G_H\n#define G_H\nint g;\n#endif");
+	out = preprocess("#include \"l.h\"\n"
+			 "#include \"g.h\"\n"
+			 "int a = __LINE__;\n"
+			 "#include \"l.h\"\n"
+			 "#include \"g.h\"\n"
+			 "int b = __LINE__;\n");
+	remove_files();
+
+	// the second inclusion replays the cached tokens
+	expecti(count(out, "int h = 2;"), 2);
+	expecti(count(out, "/l.h\"\n"), 2);
+	expectb(strstr(out, "int a = 3;") != NULL);
+	expectb(strstr(out, "# 5 \"") != NULL);
+	expectb(strstr(out, "int b = 6;") != NULL);
+	// and the guard still skips the body
+	expecti(count(out, "int g;"), 1);
+}
+
+static void test_if_char()
+{
+	const char *err;
+
+	opts.E = true;
+	expecti(mcc_run("int x;\n"
+			"#if ''\n#endif\n"
+			"#if 'ab'\n#endif\n"
+			"#if '\\777'\n#endif\n", NULL, NULL, &err),
+		EXIT_FAILURE);
+	opts.E = false;
+	remove_files();
+
+	// reported at the character constant, not the next line
+	expectb(strstr(err, "1.c:2:5:") != NULL);
+	expectb(strstr(err, "1.c:4:5:") != NULL);
+	expectb(strstr(err, "1.c:6:5:") != NULL);
+	expecti(count(err, "error:"), 3);
+}
+
+static void test_pch_write()
+{
+	const char *err;
+
+	opts.emit_pch = true;
+	expecti(mcc_run("#define X 1", "/dev/full", NULL, &err),
+		EXIT_FAILURE);
+	opts.emit_pch = false;
+	remove_files();
+
+	expectb(strstr(err, "can't write the output") != NULL);
+}
+
+static void test_macro_stats()
+{
+	const char *err;
+	char *line;
+
+	write_file("s.h", "#define SQ(x) ((x) * (x))");
+	opts.E = true;
+	opts.fmacro_stats = true;
+	expecti(mcc_run("#include \"s.h\"\n"
+			"#include \"s.h\"\n"
+			"int a = SQ(2) + SQ(3) + SQ(SQ(1));\n", NULL, NULL, &err),
+		EXIT_SUCCESS);
+	opts.E = false;
+	opts.fmacro_stats = false;
+	remove_files();
+
+	expectb(strstr(err, "Top 1 macros by expansions:") != NULL);
+	// the nested SQ is expanded too: 4 times, 13 tokens each
+	line = strstr(err, "  SQ\n");
+	expectb(line != NULL);
+	while (line[-1] != '\n')
+		line--;
+	expecti(atoi(line), 4);
+	expecti(atoi(line + 10), 52);
+
+	line = strstr(err, "/s.h\n");
+	expectb(line != NULL);
+	while (line[-1] != '\n')
+		line--;
+	expecti(atoi(line), 2);
+}
+
+void testmain()
+{
+	START("cpp ...");
+	test_header_cache();
+	test_if_char();
+	test_pch_write();
+	test_macro_stats();
+}
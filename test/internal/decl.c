@@ -0,0 +1,125 @@
+#include "internal.h"
+
+static int ir_dump(const char *code, const char **out, const char **err)
+{
+	int ret;
+
+	opts.ir_dump = true;
+	ret = mcc_run(code, NULL, out, err);
+	opts.ir_dump = false;
+	remove_files();
+	return ret;
+}
+
+static void test_lazy_names()
+{
+	const char *out;
+
+	// a skipped static inline body sees what was declared before it
+	expecti(ir_dump("typedef long T;\n"
+			"enum { E = 5 };\n"
+			"int early;\n"
+			"static inline int f1(void) { return sizeof(T); }\n"
+			"static inline int f2(void) { return E; }\n"
+			"static inline int f3(void) { return early; }\n"
+			"int main(void) { return f1() + f2() + f3(); }\n",
+			&out, NULL), EXIT_SUCCESS);
+	expectb(strstr(out, "f1:\n.t0 = (uint => int) 8\n") != NULL);
+	expectb(strstr(out, "f2:\nreturn 5\n") != NULL);
+	expectb(strstr(out, "f3:\nreturn early\n") != NULL);
+}
+
+static void test_lazy_later_global()
+{
+	const char *err;
+
+	// but not a global declared after it
+	expecti(ir_dump("static inline int g(void) { return later; }\n"
+			"int later;\n"
+			"int main(void) { return g(); }\n",
+			NULL, &err), EXIT_FAILURE);
+	expectb(strstr(err, "1.c:1:36:") != NULL);
+	expectb(strstr(err, "undeclared identifier 'later'") != NULL);
+}
+
+static void test_lazy_block_scope()
+{
+	const char *out, *err;
+
+	// nor what a later block declares
+	expecti(ir_dump("int x;\n"
+			"struct s { int a; };\n"
+			"static inline int h(struct s *p) { return x + p->a; }\n"
+			"int main(void) {\n"
+			"    typedef int x;\n"
+			"    struct s { char b; } v;\n"
+			"    return h(0);\n"
+			"}\n",
+			&out, NULL), EXIT_SUCCESS);
+	expectb(strstr(out, "h:\n") != NULL);
+	expectb(strstr(out, " = x + ") != NULL);
+
+	expecti(ir_dump("static inline int g(void) { return later; }\n"
+			"int main(void) { extern int later; return g(); }\n",
+			NULL, &err), EXIT_FAILURE);
+	expectb(strstr(err, "undeclared identifier 'later'") != NULL);
+
+	expecti(ir_dump("struct s;\n"
+			"static inline int h(struct s *p) { return p->a; }\n"
+			"int main(void) { struct s { int a; } v; return h(0); }\n",
+			NULL, &err), EXIT_FAILURE);
+	expectb(strstr(err, "1.c:2:47:") != NULL);
+	expectb(strstr(err, "incomplete definition of type 'struct s'") != NULL);
+}
+
+// the initializer list of the last declaration in 'code'
+static node_t **inits_of(const char *code)
+{
+	node_t **exts = DECL_EXTS(compile(code));
+	node_t *init = DECL_BODY(exts[LIST_LEN(exts) - 1]);
+
+	expecti(AST_ID(init), INITS_EXPR);
+	return EXPR_INITS(init);
+}
+
+// the number of holes in 'n', 0 if it is not a hole
+static int holes(node_t *n)
+{
+	return AST_ID(n) == VINIT_EXPR ? EXPR_VINIT_LEN(n) : 0;
+}
+
+static void test_sparse_init()
+{
+	node_t **inits;
+
+	// the holes before a large designator are one node
+	inits = inits_of("int a[] = {[1 << 25] = 1};");
+	expecti(LIST_LEN(inits), 2);
+	expecti(holes(inits[0]), 1 << 25);
+	expectl(ILITERAL_VALUE(inits[1]), 1);
+
+	// and a later designator splits them
+	inits = inits_of("int b[10] = {[8] = 1, [2] = 2, 3, [0] = 4};");
+	expecti(LIST_LEN(inits), 6);
+	expectl(ILITERAL_VALUE(inits[0]), 4);
+	expecti(holes(inits[1]), 1);
+	expectl(ILITERAL_VALUE(inits[2]), 2);
+	expectl(ILITERAL_VALUE(inits[3]), 3);
+	expecti(holes(inits[4]), 4);
+	expectl(ILITERAL_VALUE(inits[5]), 1);
+
+	// a struct keeps one hole per field
+	inits = inits_of("struct s { int x, y, z; } s = {.z = 1};");
+	expecti(LIST_LEN(inits), 3);
+	expecti(holes(inits[0]), 1);
+	expecti(holes(inits[1]), 1);
+}
+
+void testmain()
+{
+	START("decl ...");
+	test_lazy_names();
+	test_lazy_later_global();
+	test_lazy_block_scope();
+	test_sparse_init();
+}
@@ -0,0 +1,52 @@
+#include "internal.h"
+
+static void test_dict()
+{
+	struct dict *dict = dict_new();
+
+	expectp(dict_get(dict, "a"), NULL);
+	expecti(dict_len(dict), 0);
+
+	dict_put(dict, "c", "3");
+	dict_put(dict, "a", "1");
+	dict_put(dict, "b", "2");
+	dict_put(dict, "a", "one");
+	expecti(dict_len(dict), 3);
+	expects(dict_get(dict, "a"), "one");
+
+	// insertion order, no duplicate keys
+	expects(dict_key(dict, 0), "c");
+	expects(dict_key(dict, 1), "a");
+	expects(dict_key(dict, 2), "b");
+	expects(dict_value(dict, 1), "one");
+
+	struct vector *v = dict_values(dict);
+	expecti(vec_len(v), 3);
+	expects(vec_at(v, 2), "2");
+
+	dict_free(dict);
+}
+
+static void test_grow()
+{
+	struct dict *dict = dict_new();
+
+	for (int i = 0; i < 1000; i++)
+		dict_put(dict, format("k%d", i), strd(i));
+	for (int i = 0; i < 1000; i++)
+		dict_put(dict, format("k%d", i), strd(i));
+	expecti(dict_len(dict), 1000);
+	for (int i = 0; i < 1000; i++) {
+		expects(dict_key(dict, i), format("k%d", i));
+		expects(dict_get(dict, format("k%d", i)), strd(i));
+	}
+
+	dict_free(dict);
+}
+
+void testmain()
+{
+	START("dict ...");
+	test_dict();
+	test_grow();
+}
@@ -0,0 +1,31 @@
+#include "internal.h"
+
+// the value 'expr' folds to, as the initializer of an int
+static long fold(const char *expr)
+{
+	const char *code = format("int x = %s;", expr);
+	node_t **exts = DECL_EXTS(compile(code));
+	node_t *init = DECL_BODY(exts[LIST_LEN(exts) - 1]);
+
+	if (init == NULL || !isiliteral(init))
+		fail("not folded: " RED("%s"), code);
+	return ILITERAL_VALUE(init);
+}
+
+static void test_bool_cast()
+{
+	// a float converts to _Bool by comparing with zero
+	expectl(fold("(_Bool)0.5"), 1);
+	expectl(fold("(_Bool)0.5 == 1"), 1);
+	expectl(fold("(_Bool)-0.25"), 1);
+	expectl(fold("(_Bool)0.0 == 0"), 1);
+	expectl(fold("(_Bool)-0.0 == 0"), 1);
+	expectl(fold("(_Bool)1e-30f"), 1);
+	expectl(fold("(_Bool)2.0 + (_Bool)0.0"), 1);
+}
+
+void testmain()
+{
+	START("eval ...");
+	test_bool_cast();
+}
@@ -1,18 +1,23 @@
 #include "internal.h"
+#include <unistd.h>
+#include <fcntl.h>
+
+// mcc.c is not linked into the tests
+int version;
+struct options opts;
 
 static const char *tmpdir;
 
-static const char *write_str(const char *str)
+const char *write_file(const char *name, const char *str)
 {
 	struct strbuf *s = strbuf_new();
 	FILE *fp;
 	size_t len;
 
-	tmpdir = mktmpdir();
-	if (tmpdir == NULL)
+	if (tmpdir == NULL && (tmpdir = mktmpdir()) == NULL)
 		fail("Can't mktmpdir");
 
-	strbuf_cats(s, join(tmpdir, "1.c"));
+	strbuf_cats(s, join(tmpdir, name));
 	if (!(fp = fopen(s->str, "w")))
 		fail("Can't open file");
 
@@ -26,29 +31,97 @@ static const char *write_str(const char *str)
 	return s->str;
 }
 
+void remove_files(void)
+{
+	if (tmpdir)
+		rmdir(tmpdir);
+	tmpdir = NULL;
+}
+
+static const char *read_file(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL)
+		fail("Cannot open result file");
+	int size = file_size(path);
+	if (size < 0)
+		fail("Cannot get file size");
+
+	char *buf = malloc(size + 1);
+	if (fread(buf, 1, size, fp) != size)
+		fail("Cannot read file");
+	fclose(fp);
+	buf[size] = 0;
+	return buf;
+}
+
+static int redirect(int fd, const char *path)
+{
+	int saved = dup(fd);
+	int to = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (saved < 0 || to < 0)
+		fail("Can't redirect to %s", path);
+	dup2(to, fd);
+	close(to);
+	return saved;
+}
+
+static void restore(int fd, int saved)
+{
+	dup2(saved, fd);
+	close(saved);
+}
+
 node_t *compile(const char *code)
 {
 	node_t *n;
-	const char *ifile = write_str(code);
+	const char *ifile = write_file("1.c", code);
 	FILE *fp = freopen(ifile, "r", stdin);
 	if (fp == NULL)
 		fail("Can't open input file");
 
+	errors = 0;
 	input_init(ifile);
 	cpp_init(NULL);
 	type_init();
 	symbol_init();
 	n = translation_unit();
 	fclose(fp);
-	rmdir(tmpdir);
+	remove_files();
 	if (errors)
 		fail("Compile error:\n" RED("%s"), code);
 	return n;
 }
 
+int mcc_run(const char *code, const char *ofile,
+	    const char **out, const char **err)
+{
+	const char *ifile = write_file("1.c", code);
+	const char *outfile = join(tmpdir, "stdout");
+	const char *errfile = join(tmpdir, "stderr");
+	int fd1, fd2, ret;
+
+	fflush(stdout);
+	fflush(stderr);
+	fd1 = redirect(1, outfile);
+	fd2 = redirect(2, errfile);
+	errors = 0;
+	ret = cc_main(ifile, ofile);
+	fflush(stdout);
+	fflush(stderr);
+	restore(1, fd1);
+	restore(2, fd2);
+
+	if (out)
+		*out = read_file(outfile);
+	if (err)
+		*err = read_file(errfile);
+	return ret;
+}
+
 const char *gcc_compile(const char *code)
 {
-	const char *ifile = write_str(code);
+	const char *ifile = write_file("1.c", code);
 	const char *ofile = join(tmpdir, "a.out");
 	const char *argv[] = { "/usr/bin/gcc", ifile, "-o", ofile, NULL };
 	callsys(argv[0], (char **)argv);
@@ -62,21 +135,7 @@ const char *gcc_compile(const char *code)
 	if (!file_exists(rfile))
 		fail("run binary failed");
 
-	FILE *fp = fopen(rfile, "r");
-	if (fp == NULL)
-		fail("Cannot open result file");
-	int size = file_size(rfile);
-	if (size < 0)
-		fail("Cannot get file size");
-	if (size == 0)
-		return NULL;
-
-	char *buf = malloc(size + 1);
-	if (fread(buf, 1, size, fp) != size)
-		fail("Cannot read file");
-	fclose(fp);
-	buf[size] = 0;
-
-	rmdir(tmpdir);
-	return buf;
+	const char *buf = read_file(rfile);
+	remove_files();
+	return *buf ? buf : NULL;
 }
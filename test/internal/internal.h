@@ -12,6 +12,15 @@
 // mcc compile
 extern node_t *compile(const char *code);
 
+// files of one test, 'code' of compile() and mcc_run() is "1.c"
+extern const char *write_file(const char *name, const char *str);
+extern void remove_files(void);
+
+// run the driver on 'code' with the current 'opts', collecting
+// what it writes to stdout and stderr
+extern int mcc_run(const char *code, const char *ofile,
+		   const char **out, const char **err);
+
 // gcc compile
 extern const char *gcc_compile(const char *code);
 
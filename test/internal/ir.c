@@ -0,0 +1,124 @@
+#include "internal.h"
+
+// the three-address code of function 'name' in 'code'
+static struct tac *ir_of(const char *code, const char *name)
+{
+	struct externals *exts = ir(compile(code));
+
+	for (int i = 0; i < vec_len(exts->gdatas); i++) {
+		struct gdata *gdata = vec_at(exts->gdatas, i);
+		if (gdata->id != GDATA_TEXT)
+			continue;
+		node_t *decl = gdata->u.decl;
+		if (!strcmp(SYM_NAME(DECL_SYM(decl)), name))
+			return DECL_X_HEAD(decl);
+	}
+	fail("no function '%s'", name);
+	return NULL;
+}
+
+// the number of stores to 'name'
+static int stores(struct tac *tac, const char *name)
+{
+	int n = 0;
+	for (; tac; tac = tac->next) {
+		struct operand *result = tac->result;
+		if (result && result->sym && SYM_NAME(result->sym) &&
+		    !strcmp(SYM_NAME(result->sym), name))
+			n++;
+	}
+	return n;
+}
+
+static int ir_dump(const char *code, const char **out, const char **err)
+{
+	int ret;
+
+	opts.ir_dump = true;
+	ret = mcc_run(code, NULL, out, err);
+	opts.ir_dump = false;
+	remove_files();
+	return ret;
+}
+
+static void test_compound_assign()
+{
+	struct tac *tac;
+
+	// the lvalue's side effect is evaluated once
+	tac = ir_of("int a[10]; void f(int i) { a[i++] += 1; }", "f");
+	expecti(stores(tac, "i"), 1);
+	expecti(stores(tac, "a"), 1);
+
+	tac = ir_of("struct s { int x[4]; } s;"
+		    "void f(int i, int *p) { s.x[i += 1] *= 3; *p++ |= 4; }",
+		    "f");
+	expecti(stores(tac, "i"), 1);
+	expecti(stores(tac, "s"), 1);
+	expecti(stores(tac, "p"), 1);
+
+	// an identity leaves the lvalue alone
+	tac = ir_of("int f(int z) { z -= 0; z *= 1; z |= 0; return z; }",
+		    "f");
+	expecti(stores(tac, "z"), 0);
+	tac = ir_of("volatile int v; void f(void) { v -= 0; }", "f");
+	expecti(stores(tac, "v"), 1);
+}
+
+static void test_switch_search()
+{
+	const char *out;
+
+	// more than 8 cases split in halves, signed by the switch type
+	expecti(ir_dump("int f(int x) { switch (x) {\n"
+			"case -5: return 1; case -3: return 2; case -1: return 3;\n"
+			"case 0: return 4; case 2: return 5; case 4: return 6;\n"
+			"case 6: return 7; case 8: return 8; case 10: return 9;\n"
+			"} return 0; }\n"
+			"int g(unsigned x) { switch (x) {\n"
+			"case 0: return 1; case 1: return 2; case 2: return 3;\n"
+			"case 3: return 4; case 4: return 5; case 5: return 6;\n"
+			"case 6: return 7; case 0x80000000u: return 8;\n"
+			"case 0xffffffffu: return 9;\n"
+			"} return 0; }\n", &out, NULL), EXIT_SUCCESS);
+	expectb(strstr(out, "f:\nif x < 2 goto ") != NULL);
+	expectb(strstr(out, "if x == -5 goto ") != NULL);
+	expectb(strstr(out, "g:\nif x <u 4 goto ") != NULL);
+	expectb(strstr(out, "if x == 2147483648 goto ") != NULL);
+	expectb(strstr(out, "if x == 4294967295 goto ") != NULL);
+
+	// an ordinary comparison takes the operand type
+	expecti(ir_dump("int f(int a, unsigned b, int *p, int *q) {\n"
+			"return a < 0 && b < 1 && p < q && a == 2; }\n",
+			&out, NULL), EXIT_SUCCESS);
+	expectb(strstr(out, "ifFalse a < 0 goto ") != NULL);
+	expectb(strstr(out, "ifFalse b <u 1 goto ") != NULL);
+	expectb(strstr(out, "ifFalse p <u q goto ") != NULL);
+	expectb(strstr(out, "ifFalse a == 2 goto ") != NULL);
+}
+
+static void test_duplicate_case()
+{
+	const char *err;
+
+	// cases are compared as values of the switch type
+	expecti(ir_dump("int f(unsigned x) { switch (x) {\n"
+			"case 0x80000000u: return 1;\n"
+			"case -2147483647 - 1: return 2;\n"
+			"case 1: case 1: return 3;\n"
+			"case 2: case 3: return 4;\n"
+			"} return 0; }\n", NULL, &err), EXIT_FAILURE);
+	expectb(strstr(err, "1.c:3:1:") != NULL);
+	expectb(strstr(err, "duplicate case value '2147483648'") != NULL);
+	expectb(strstr(err, "1.c:4:9:") != NULL);
+	expectb(strstr(err, "duplicate case value '1'") != NULL);
+	expectb(strstr(err, "duplicate case value '2'") == NULL);
+}
+
+void testmain()
+{
+	START("ir ...");
+	test_compound_assign();
+	test_switch_search();
+	test_duplicate_case();
+}
@@ -31,8 +31,78 @@ static void test_map()
 	map_free(map);
 }
 
+static void test_grow()
+{
+	struct map *map = map_new();
+	struct vector *keys = vec_new();
+
+	for (int i = 0; i < 1000; i++) {
+		const char *key = strs(format("k%d", i));
+		vec_push(keys, (char *)key);
+		map_put(map, key, (void *)key);
+	}
+	expecti(map->size, 1000);
+	expecti(vec_len(map_keys(map)), 1000);
+
+	// remove every other key
+	for (int i = 0; i < 1000; i += 2)
+		map_put(map, vec_at(keys, i), NULL);
+	expecti(map->size, 500);
+
+	for (int i = 0; i < 1000; i++) {
+		const char *key = vec_at(keys, i);
+		expectp(map_get(map, key), i % 2 ? (void *)key : NULL);
+	}
+
+	map_free(map);
+}
+
+static void test_ptrmap()
+{
+	struct map *map = ptrmap_new();
+	char key1[] = "key";
+	char key2[] = "key";
+
+	map_put(map, key1, "value1");
+	expects(map_get(map, key1), "value1");
+	expectp(map_get(map, key2), NULL);
+
+	map_put(map, key2, "value2");
+	expects(map_get(map, key1), "value1");
+	expects(map_get(map, key2), "value2");
+
+	map_put(map, key1, NULL);
+	expectp(map_get(map, key1), NULL);
+	expects(map_get(map, key2), "value2");
+
+	map_free(map);
+}
+
+// small integers as keys, including 0
+static void test_intkey()
+{
+	struct map *map = ptrmap_new();
+
+	expectp(map_get(map, (void *)0), NULL);
+	for (long i = 0; i < 100; i++)
+		map_put(map, (void *)i, (void *)(i + 1));
+	for (long i = 0; i < 100; i++)
+		expectp(map_get(map, (void *)i), (void *)(i + 1));
+	expectp(map_get(map, (void *)100), NULL);
+	expecti(map->size, 100);
+
+	map_put(map, (void *)0, NULL);
+	expectp(map_get(map, (void *)0), NULL);
+	expecti(map->size, 99);
+
+	map_free(map);
+}
+
 void testmain()
 {
 	START("map ...");
 	test_map();
+	test_grow();
+	test_ptrmap();
+	test_intkey();
 }
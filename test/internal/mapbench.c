@@ -0,0 +1,244 @@
+#include "internal.h"
+
+/* The chained map that utils/map.c replaced, kept here
+ * to compare against.
+ */
+struct chain_entry {
+	const void *key;
+	void *value;
+	struct chain_entry *next;
+};
+
+struct chain_map {
+	unsigned size, tablesize;
+	unsigned grow_at, shrink_at;
+	struct chain_entry **table;
+};
+
+static void chain_alloc(struct chain_map *map, unsigned size)
+{
+	map->table = zmalloc(size * sizeof(struct chain_entry *));
+	map->tablesize = size;
+	map->grow_at = (unsigned)(size * 80 / 100);
+	map->shrink_at = map->grow_at / ((1 << 2) + 1);
+}
+
+static unsigned chain_bucket(struct chain_map *map, const void *key)
+{
+	return strhash(key) & (map->tablesize - 1);
+}
+
+static void chain_rehash(struct chain_map *map, unsigned newsize)
+{
+	unsigned oldsize = map->tablesize;
+	struct chain_entry **oldtable = map->table;
+
+	chain_alloc(map, newsize);
+	for (int i = 0; i < oldsize; i++) {
+		struct chain_entry *entry = oldtable[i];
+		while (entry) {
+			struct chain_entry *next = entry->next;
+			unsigned b = chain_bucket(map, entry->key);
+			entry->next = map->table[b];
+			map->table[b] = entry;
+			entry = next;
+		}
+	}
+	free(oldtable);
+}
+
+static struct chain_entry **chain_find(struct chain_map *map, const void *key)
+{
+	struct chain_entry **entry = &map->table[chain_bucket(map, key)];
+	while (*entry && (*entry)->key != key && strcmp((*entry)->key, key))
+		entry = &(*entry)->next;
+	return entry;
+}
+
+static void chain_remove(struct chain_map *map, const void *key)
+{
+	struct chain_entry **entry = chain_find(map, key);
+	if (!*entry)
+		return;
+
+	struct chain_entry *old = *entry;
+	*entry = old->next;
+	free(old);
+
+	map->size--;
+	if (map->size < map->shrink_at)
+		chain_rehash(map, map->tablesize >> 2);
+}
+
+static void chain_add(struct chain_map *map, const void *key, void *value)
+{
+	unsigned b = chain_bucket(map, key);
+	struct chain_entry *entry = zmalloc(sizeof(struct chain_entry));
+	entry->key = key;
+	entry->value = value;
+	entry->next = map->table[b];
+	map->table[b] = entry;
+	map->size++;
+	if (map->size > map->grow_at)
+		chain_rehash(map, map->tablesize << 2);
+}
+
+static struct chain_map *chain_new(void)
+{
+	struct chain_map *map = zmalloc(sizeof(struct chain_map));
+	chain_alloc(map, 64);
+	return map;
+}
+
+static void chain_free(struct chain_map *map)
+{
+	for (int i = 0; i < map->tablesize; i++) {
+		struct chain_entry *entry = map->table[i];
+		while (entry) {
+			struct chain_entry *next = entry->next;
+			free(entry);
+			entry = next;
+		}
+	}
+	free(map->table);
+	free(map);
+}
+
+static void *chain_get(struct chain_map *map, const void *key)
+{
+	struct chain_entry *entry = *chain_find(map, key);
+	return entry ? entry->value : NULL;
+}
+
+static void chain_put(struct chain_map *map, const void *key, void *value)
+{
+	chain_remove(map, key);
+	if (value)
+		chain_add(map, key, value);
+}
+
+/* Benchmark
+ *
+ * Interned identifiers like the symbol tables use:
+ * insert, hit, miss, update and remove. Keys are looked
+ * up in a different order than they were inserted.
+ */
+#define NKEYS    50000
+#define ROUNDS   10
+
+static const char *keys[NKEYS];
+static const char *misses[NKEYS];
+static int order[NKEYS];
+
+struct bench {
+	double insert, hit, miss, update, remove;
+};
+
+static void bench_map(struct bench *b)
+{
+	double t;
+	for (int r = 0; r < ROUNDS; r++) {
+		struct map *map = map_new();
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			map_put(map, keys[i], (void *)keys[i]);
+		b->insert += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			expectp(map_get(map, keys[order[i]]),
+				(void *)keys[order[i]]);
+		b->hit += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			expectp(map_get(map, misses[order[i]]), NULL);
+		b->miss += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			map_put(map, keys[i], (void *)misses[i]);
+		b->update += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			map_put(map, keys[i], NULL);
+		b->remove += wall_time() - t;
+
+		expecti(map->size, 0);
+		map_free(map);
+	}
+}
+
+static void bench_chain(struct bench *b)
+{
+	double t;
+	for (int r = 0; r < ROUNDS; r++) {
+		struct chain_map *map = chain_new();
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			chain_put(map, keys[i], (void *)keys[i]);
+		b->insert += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			expectp(chain_get(map, keys[order[i]]),
+				(void *)keys[order[i]]);
+		b->hit += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			expectp(chain_get(map, misses[order[i]]), NULL);
+		b->miss += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			chain_put(map, keys[i], (void *)misses[i]);
+		b->update += wall_time() - t;
+
+		t = wall_time();
+		for (int i = 0; i < NKEYS; i++)
+			chain_put(map, keys[i], NULL);
+		b->remove += wall_time() - t;
+
+		expecti(map->size, 0);
+		chain_free(map);
+	}
+}
+
+static void print_bench(const char *name, struct bench *b)
+{
+	printf("\n  %-8s insert %7.2fms  hit %7.2fms  miss %7.2fms  "
+	       "update %7.2fms  remove %7.2fms",
+	       name, b->insert * 1000 / ROUNDS, b->hit * 1000 / ROUNDS,
+	       b->miss * 1000 / ROUNDS, b->update * 1000 / ROUNDS,
+	       b->remove * 1000 / ROUNDS);
+}
+
+void testmain()
+{
+	START("map bench ...");
+
+	for (int i = 0; i < NKEYS; i++) {
+		keys[i] = strs(format("id%d", i));
+		misses[i] = strs(format("miss%d", i));
+		order[i] = i;
+	}
+	srand(1);
+	for (int i = NKEYS - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		int tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	struct bench map = { 0 }, chain = { 0 };
+	bench_chain(&chain);
+	bench_map(&map);
+
+	print_bench("chained", &chain);
+	print_bench("robin", &map);
+	printf("\n%-20s", "");
+}
@@ -15,8 +15,34 @@ static void test_strip()
 	expectp(NULL, strs(s1->str));
 }
 
+static void test_intern()
+{
+	char *s1 = strs("identifier");
+	char *s2 = strn("identifier_tail", 10);
+
+	expectp(s1, s2);
+	expects(s1, "identifier");
+	expecti(strs_len(s1), 10);
+	expecti(strs_hash(s1), strhashn("identifier", 10));
+	expecti(strs_hash(s1), strhash("identifier"));
+
+	// a prefix is a different string
+	expects(strn("identifier", 5), "ident");
+	expectp(strn(NULL, 3), NULL);
+	expectp(strs(""), NULL);
+
+	// survive growing the table
+	struct vector *v = vec_new();
+	for (int i = 0; i < 5000; i++)
+		vec_push(v, strs(format("s%d", i)));
+	for (int i = 0; i < 5000; i++)
+		expectp(strs(format("s%d", i)), vec_at(v, i));
+	expectp(strs("identifier"), s1);
+}
+
 void testmain()
 {
 	START("string ...");
 	test_strip();
+	test_intern();
 }
@@ -12,7 +12,7 @@ static void test_lookup()
 	expecti(SCOPE, GLOBAL);
 
 	const char *name1 = strs("name1");
-	sym = install(name1, &identifiers, SCOPE);
+	sym = install(name1, identifiers, SCOPE);
 	expects(SYM_NAME(sym), "name1");
 
 	sym2 = lookup(name1, identifiers);
@@ -29,10 +29,10 @@ static void test_scope()
 	node_t *sym = lookup(name1, identifiers);
 	expecti(SYM_SCOPE(sym), GLOBAL);
 
-	node_t *sym2 = install(name1, &identifiers, SCOPE);
+	node_t *sym2 = install(name1, identifiers, SCOPE);
 	expectb(sym != sym2);
-	expectp(identifiers->up->up, NULL);
 	expecti(SYM_SCOPE(sym2), SYM_SCOPE(sym) + 1);
+	expectp(lookup(name1, identifiers), sym2);
 
 	exit_scope();
 	expecti(SCOPE, GLOBAL);
@@ -40,10 +40,41 @@ static void test_scope()
 	expectp(sym3, sym);
 }
 
+static void test_shadow()
+{
+	const char *name2 = strs("name2");
+	const char *name3 = strs("name3");
+
+	node_t *g = install(name2, identifiers, GLOBAL);
+	enter_scope();
+	node_t *p = install(name2, identifiers, SCOPE);
+	enter_scope();
+	node_t *l = install(name2, identifiers, SCOPE);
+	node_t *l2 = install(name3, identifiers, SCOPE);
+	expectp(lookup(name2, identifiers), l);
+
+	// declared at file scope from a block
+	node_t *g3 = install(name3, identifiers, GLOBAL);
+	expectp(lookup(name3, identifiers), l2);
+
+	// redeclared in the same scope
+	node_t *l3 = install(name2, identifiers, SCOPE);
+	expectp(lookup(name2, identifiers), l3);
+
+	exit_scope();
+	expectp(lookup(name2, identifiers), p);
+	expectp(lookup(name3, identifiers), g3);
+	exit_scope();
+	expectp(lookup(name2, identifiers), g);
+	expectp(lookup(name3, identifiers), g3);
+	expecti(SCOPE, GLOBAL);
+}
+
 void testmain()
 {
 	START("symbol ...");
 	symbol_init();
 	test_lookup();
 	test_scope();
+	test_shadow();
 }
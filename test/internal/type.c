@@ -37,10 +37,65 @@ static void test_eq()
 
 }
 
+static void test_unique()
+{
+	node_t *ty1, *ty2;
+
+	expectp(ptr_type(inttype), ptr_type(inttype));
+	expectp(qual(CONST, inttype), qual(CONST, inttype));
+	expectp(qual(VOLATILE, qual(CONST, inttype)),
+		qual(CONST + VOLATILE, inttype));
+
+	ty1 = ptr_type(qual(CONST, chartype));
+	ty2 = ptr_type(qual(CONST, chartype));
+	expectp(ty1, ty2);
+	expecti(ty1 == ptr_type(chartype), false);
+
+	// a declarator pointer is made canonical once complete
+	ty1 = ptr_type(NULL);
+	expecti(ty1 == ptr_type(NULL), false);
+	attach_type(&ty1, qual(CONST, chartype));
+	expectp(canonical(ty1), ty2);
+}
+
+static node_t *record(int n)
+{
+	struct vector *v = vec_new();
+	for (int i = 0; i < n; i++) {
+		node_t *field = new_field();
+		FIELD_NAME(field) = strs(format("f%d", i));
+		vec_push(v, field);
+	}
+	node_t *ty = alloc_type();
+	_TYPE_KIND(ty) = STRUCT;
+	_TYPE_FIELDS(ty) = (node_t **) vtoa(v);
+	return ty;
+}
+
+static void test_field()
+{
+	// scanned and indexed records
+	int sizes[] = { 3, 100 };
+	for (int k = 0; k < 2; k++) {
+		node_t *ty = record(sizes[k]);
+		for (int i = 0; i < sizes[k]; i++) {
+			node_t *field = find_field(ty, strs(format("f%d", i)));
+			expectp(field, TYPE_FIELDS(ty)[i]);
+			expecti(indexof_field(ty, field), i);
+		}
+		expectp(find_field(qual(CONST, ty), strs("f1")),
+			TYPE_FIELDS(ty)[1]);
+		expectp(find_field(ty, strs("f1000")), NULL);
+		expectp(find_field(ty, NULL), NULL);
+	}
+}
+
 void testmain()
 {
 	START("type ...");
 	type_init();
 	test_qual();
 	test_eq();
+	test_unique();
+	test_field();
 }
@@ -0,0 +1,83 @@
+#include "internal.h"
+
+static char items[100];
+
+static void test_push()
+{
+	struct vector *v = vec_new();
+
+	for (int i = 0; i < 100; i++)
+		vec_push(v, &items[i]);
+	expecti(vec_len(v), 100);
+	for (int i = 0; i < 100; i++)
+		expectp(vec_at(v, i), &items[i]);
+	expectp(vec_pop(v), &items[99]);
+	expectp(vec_tail(v), &items[98]);
+
+	vec_free(v);
+}
+
+static void test_deque()
+{
+	struct vector *v = vec_new();
+
+	// front and back
+	for (int i = 50; i < 100; i++)
+		vec_push(v, &items[i]);
+	for (int i = 49; i >= 0; i--)
+		vec_push_front(v, &items[i]);
+	expecti(vec_len(v), 100);
+	for (int i = 0; i < 100; i++)
+		expectp(vec_at(v, i), &items[i]);
+
+	// as a queue
+	for (int n = 0; n < 10; n++) {
+		for (int i = 0; i < 100; i++) {
+			expectp(vec_pop_front(v), &items[i]);
+			vec_push(v, &items[i]);
+		}
+	}
+	expecti(vec_len(v), 100);
+	expectp(vec_head(v), &items[0]);
+	expectp(vec_tail(v), &items[99]);
+
+	while (vec_len(v))
+		vec_pop_front(v);
+	expectp(vec_pop_front(v), NULL);
+	vec_push_front(v, &items[1]);
+	expectp(vec_head(v), &items[1]);
+
+	vec_clear(v);
+	expecti(vec_len(v), 0);
+	vec_push(v, &items[2]);
+	expectp(vec_at(v, 0), &items[2]);
+
+	vec_free(v);
+}
+
+static void test_insert()
+{
+	struct vector *v = vec_new();
+
+	for (int i = 0; i < 100; i += 2)
+		vec_push(v, &items[i]);
+	for (int i = 1; i < 100; i += 2)
+		vec_insert(v, i, &items[i]);
+	vec_insert(v, 0, &items[99]);
+	vec_insert(v, 101, &items[0]);
+	expecti(vec_len(v), 102);
+	expectp(vec_head(v), &items[99]);
+	expectp(vec_tail(v), &items[0]);
+	for (int i = 0; i < 100; i++)
+		expectp(vec_at(v, i + 1), &items[i]);
+
+	vec_free(v);
+}
+
+void testmain()
+{
+	START("vector ...");
+	test_push();
+	test_deque();
+	test_insert();
+}
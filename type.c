@@ -1,47 +1,83 @@
 #include "cc.h"
 
 // predefined types
-node_t *chartype;                // char
-node_t *unsignedchartype;        // unsigned char
-node_t *signedchartype;          // signed char
-node_t *wchartype;               // wchar_t
-node_t *shorttype;               // short (int)
-node_t *unsignedshorttype;       // unsigned short (int)
-node_t *inttype;                 // int
-node_t *unsignedinttype;         // unsigned (int)
-node_t *longtype;                // long
-node_t *unsignedlongtype;        // unsigned long (int)
-node_t *longlongtype;            // long long (int)
-node_t *unsignedlonglongtype;    // unsigned long long (int)
-node_t *floattype;               // float
-node_t *doubletype;              // double
-node_t *longdoubletype;          // long double
-node_t *voidtype;                // void
-node_t *booltype;                // bool
+THREAD_LOCAL node_t *chartype;                // char
+THREAD_LOCAL node_t *unsignedchartype;        // unsigned char
+THREAD_LOCAL node_t *signedchartype;          // signed char
+THREAD_LOCAL node_t *wchartype;               // wchar_t
+THREAD_LOCAL node_t *shorttype;               // short (int)
+THREAD_LOCAL node_t *unsignedshorttype;       // unsigned short (int)
+THREAD_LOCAL node_t *inttype;                 // int
+THREAD_LOCAL node_t *unsignedinttype;         // unsigned (int)
+THREAD_LOCAL node_t *longtype;                // long
+THREAD_LOCAL node_t *unsignedlongtype;        // unsigned long (int)
+THREAD_LOCAL node_t *longlongtype;            // long long (int)
+THREAD_LOCAL node_t *unsignedlonglongtype;    // unsigned long long (int)
+THREAD_LOCAL node_t *floattype;               // float
+THREAD_LOCAL node_t *doubletype;              // double
+THREAD_LOCAL node_t *longdoubletype;          // long double
+THREAD_LOCAL node_t *voidtype;                // void
+THREAD_LOCAL node_t *booltype;                // bool
 
 struct metrics {
     size_t size;
     int align;
     unsigned rank;
 };
-static struct metrics boolmetrics;
-static struct metrics charmetrics;
-static struct metrics shortmetrics;
-static struct metrics wcharmetrics;
-static struct metrics intmetrics;
-static struct metrics longmetrics;
-static struct metrics longlongmetrics;
-static struct metrics floatmetrics;
-static struct metrics doublemetrics;
-static struct metrics longdoublemetrics;
-static struct metrics ptrmetrics;
-static struct metrics zerometrics;
+static THREAD_LOCAL struct metrics boolmetrics;
+static THREAD_LOCAL struct metrics charmetrics;
+static THREAD_LOCAL struct metrics shortmetrics;
+static THREAD_LOCAL struct metrics wcharmetrics;
+static THREAD_LOCAL struct metrics intmetrics;
+static THREAD_LOCAL struct metrics longmetrics;
+static THREAD_LOCAL struct metrics longlongmetrics;
+static THREAD_LOCAL struct metrics floatmetrics;
+static THREAD_LOCAL struct metrics doublemetrics;
+static THREAD_LOCAL struct metrics longdoublemetrics;
+static THREAD_LOCAL struct metrics ptrmetrics;
+static THREAD_LOCAL struct metrics zerometrics;
+
+/* Pointer and qualified types are hash-consed: there is
+ * one node per (kind, base type), so a derived type is
+ * shared by all its uses and eqtype() stops at the first
+ * pointer compare. The table is keyed by the nodes
+ * themselves.
+ *
+ * Arrays and functions are still allocated per declarator,
+ * their lengths and parameters are filled in after the
+ * node is made.
+ */
+static THREAD_LOCAL struct map *types;
+
+static unsigned type_hash(const void *key)
+{
+    node_t *ty = (node_t *) key;
+    uint64_t h = ((uintptr_t) _TYPE_TYPE(ty) >> 3) * 31 + _TYPE_KIND(ty);
+    return h * 0x9E3779B97F4A7C15ull >> 32;
+}
+
+static int type_cmp(const void *key1, const void *key2)
+{
+    node_t *ty1 = (node_t *) key1;
+    node_t *ty2 = (node_t *) key2;
+    return !(_TYPE_KIND(ty1) == _TYPE_KIND(ty2) &&
+             _TYPE_TYPE(ty1) == _TYPE_TYPE(ty2));
+}
 
 static inline node_t *new_type(void)
 {
     return alloc_type();
 }
 
+// the canonical node of a derived type, NULL if none yet
+static node_t *find_type(int kind, node_t * type)
+{
+    node_t key;
+    _TYPE_KIND(&key) = kind;
+    _TYPE_TYPE(&key) = type;
+    return map_get(types, &key);
+}
+
 static node_t *install_type(const char *name, int kind, struct metrics m)
 {
     node_t *ty = new_type();
@@ -102,6 +138,10 @@ static void metrics_init(void)
 
 void type_init(void)
 {
+    types = map_new();
+    types->hashfn = type_hash;
+    types->cmpfn = type_cmp;
+
     metrics_init();
 #define INSTALL(type, name, kind, metrics, op)    type = install_type(name, kind, metrics)
 
@@ -261,13 +301,16 @@ node_t *qual(int t, node_t * ty)
         return ty;
     
     cc_assert(isconst1(t) || isvolatile1(t) || isrestrict1(t));
-    
-    node_t *qty = new_type();
-    if (isqual(ty))
-        _TYPE_KIND(qty) = combine(t, _TYPE_KIND(ty));
-    else
-        _TYPE_KIND(qty) = t;
+
+    int kind = isqual(ty) ? combine(t, _TYPE_KIND(ty)) : t;
+    node_t *qty = find_type(kind, unqual(ty));
+    if (qty)
+        return qty;
+
+    qty = new_type();
+    _TYPE_KIND(qty) = kind;
     _TYPE_TYPE(qty) = unqual(ty);
+    map_put(types, qty, qty);
     return qty;
 }
 
@@ -310,18 +353,52 @@ node_t *array_type(node_t * type)
     return ty;
 }
 
+/**
+ * A NULL 'type' makes a new pointer for a declarator to
+ * fill in, it is made canonical by canonical().
+ */
 node_t *ptr_type(node_t * type)
 {
-    node_t *ty = new_type();
+    node_t *ty = type ? find_type(POINTER, type) : NULL;
+    if (ty)
+        return ty;
+
+    ty = new_type();
     _TYPE_KIND(ty) = POINTER;
     _TYPE_NAME(ty) = "pointer";
     _TYPE_TYPE(ty) = type;
     _TYPE_SIZE(ty) = ptrmetrics.size;
     _TYPE_ALIGN(ty) = ptrmetrics.align;
+    if (type)
+        map_put(types, ty, ty);
 
     return ty;
 }
 
+/**
+ * Replace the pointers and qualifiers of a complete
+ * declarator type by their canonical nodes. Arrays and
+ * functions are updated in place.
+ */
+node_t *canonical(node_t * ty)
+{
+    if (ty == NULL)
+        return NULL;
+
+    switch (_TYPE_KIND(ty)) {
+    case POINTER:
+        return ptr_type(canonical(_TYPE_TYPE(ty)));
+    case ARRAY:
+    case FUNCTION:
+        _TYPE_TYPE(ty) = canonical(_TYPE_TYPE(ty));
+        return ty;
+    default:
+        if (isqual(ty))
+            return qual(_TYPE_KIND(ty), canonical(_TYPE_TYPE(ty)));
+        return ty;
+    }
+}
+
 node_t *func_type(void)
 {
     node_t *ty = new_type();
@@ -351,9 +428,9 @@ node_t *tag_type(int t, const char *tag, struct source src)
             redefinition_error(src, sym);
         }
 
-        sym = install(tag, &tags, SCOPE);
+        sym = install(tag, tags, SCOPE);
     } else {
-        sym = anonymous(&tags, SCOPE);
+        sym = anonymous(tags, SCOPE);
         _TYPE_TAG(ty) = SYM_NAME(sym);
     }
 
@@ -466,17 +543,53 @@ bool eqtype(node_t * ty1, node_t * ty2)
     }
 }
 
+/* Fields of large records
+ *
+ * A record with more than FIELD_INDEX_MIN fields gets an
+ * index on its first lookup, which maps each field name
+ * to its slot in TYPE_FIELDS. Smaller records are scanned.
+ * Field names are interned, so they compare by identity.
+ */
+#define FIELD_INDEX_MIN     16
+
+static struct map *field_index(node_t * ty)
+{
+    if (_TYPE_INDEX(ty))
+        return _TYPE_INDEX(ty);
+
+    node_t **fields = _TYPE_FIELDS(ty);
+    int len = LIST_LEN(fields);
+    if (len <= FIELD_INDEX_MIN)
+        return NULL;
+
+    struct map *index = ptrmap_new();
+    for (int i = 0; i < len; i++) {
+        const char *name = FIELD_NAME(fields[i]);
+        // the first of duplicated names wins
+        if (name && !map_get(index, name))
+            map_put(index, name, &fields[i]);
+    }
+    _TYPE_INDEX(ty) = index;
+    return index;
+}
+
+// 'name' must be interned
 node_t *find_field(node_t * sty, const char *name)
 {
-    int i;
     node_t *ty = unqual(sty);
-    int len = LIST_LEN(TYPE_FIELDS(ty));
+    node_t **fields = _TYPE_FIELDS(ty);
 
-    if (name == NULL)
+    if (name == NULL || fields == NULL)
         return NULL;
-    for (i = 0; i < len; i++) {
-        node_t *field = TYPE_FIELDS(ty)[i];
-        if (FIELD_NAME(field) && !strcmp(name, FIELD_NAME(field)))
+
+    struct map *index = field_index(ty);
+    if (index) {
+        node_t **slot = map_get(index, name);
+        return slot ? *slot : NULL;
+    }
+    for (int i = 0; fields[i]; i++) {
+        node_t *field = fields[i];
+        if (FIELD_NAME(field) == name)
             return field;
     }
 
@@ -485,9 +598,16 @@ node_t *find_field(node_t * sty, const char *name)
 
 int indexof_field(node_t * ty, node_t * field)
 {
-    for (int i = 0; i < LIST_LEN(TYPE_FIELDS(ty)); i++) {
-        node_t *f = TYPE_FIELDS(ty)[i];
-        if (field == f)
+    node_t **fields = TYPE_FIELDS(ty);
+    struct map *index = field_index(unqual(ty));
+
+    if (index && FIELD_NAME(field)) {
+        node_t **slot = map_get(index, FIELD_NAME(field));
+        if (slot && *slot == field)
+            return slot - fields;
+    }
+    for (int i = 0; fields[i]; i++) {
+        if (fields[i] == field)
             return i;
     }
     cc_assert(0);
@@ -646,7 +766,8 @@ bool isincomplete(node_t * ty)
     else if (isarray(ty))
         return TYPE_SIZE(ty) == 0;
     else if (isenum(ty) || isstruct(ty) || isunion(ty))
-        return !SYM_DEFINED(TYPE_TSYM(ty));
+        return !SYM_DEFINED(TYPE_TSYM(ty)) ||
+            is_hidden(SYM_GEN(TYPE_TSYM(ty)));
     else
         return false;
 }
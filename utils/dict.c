@@ -1,41 +1,110 @@
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include "utils.h"
 
+#define DICT_INIT_SIZE      16
+
+static void alloc_index(struct dict *dict, unsigned size)
+{
+    free(dict->index);
+    dict->index = xcalloc(size, sizeof(unsigned));
+    dict->tablesize = size;
+    unsigned mask = size - 1;
+    for (unsigned i = 0; i < dict->size; i++) {
+        unsigned j = dict->entries[i].hash & mask;
+        while (dict->index[j])
+            j = (j + 1) & mask;
+        dict->index[j] = i + 1;
+    }
+}
+
+// slot of 'key' in the index, or the empty slot to put it
+static unsigned find_slot(struct dict *dict, const void *key, unsigned hash)
+{
+    unsigned mask = dict->tablesize - 1;
+    unsigned j = hash & mask;
+    for (; dict->index[j]; j = (j + 1) & mask) {
+        struct dict_entry *e = &dict->entries[dict->index[j] - 1];
+        if (e->key == key ||
+            (e->hash == hash && !strcmp(e->key, key)))
+            break;
+    }
+    return j;
+}
+
 struct dict *dict_new(void)
 {
     struct dict *dict = zmalloc(sizeof(struct dict));
-    dict->map = map_new();
-    dict->keys = vec_new();
+    alloc_index(dict, DICT_INIT_SIZE);
     return dict;
 }
 
 void dict_free(struct dict *dict)
 {
-    map_free(dict->map);
-    vec_free(dict->keys);
+    free(dict->entries);
+    free(dict->index);
     free(dict);
 }
 
+/**
+ * Update the value of an existing key in place, otherwise
+ * append a new entry. Entries can't be removed.
+ */
 void dict_put(struct dict *dict, const void *key, void *value)
 {
-    map_put(dict->map, key, value);
-    vec_push(dict->keys, (void *)key);
+    unsigned hash = strhash(key);
+    unsigned j = find_slot(dict, key, hash);
+    if (dict->index[j]) {
+        dict->entries[dict->index[j] - 1].value = value;
+        return;
+    }
+
+    if (dict->size == dict->alloc) {
+        dict->alloc = dict->alloc ? dict->alloc << 1 : DICT_INIT_SIZE / 2;
+        dict->entries = xrealloc(dict->entries,
+                                 dict->alloc * sizeof(struct dict_entry));
+    }
+    dict->entries[dict->size++] = (struct dict_entry){
+        .key = key,.value = value,.hash = hash};
+    // keep the index at most half full
+    if (dict->size * 2 > dict->tablesize)
+        alloc_index(dict, dict->tablesize << 1);
+    else
+        dict->index[j] = dict->size;
 }
 
 void *dict_get(struct dict *dict, const void *key)
 {
-    return map_get(dict->map, key);
+    unsigned j = find_slot(dict, key, strhash(key));
+    if (dict->index[j])
+        return dict->entries[dict->index[j] - 1].value;
+    return NULL;
+}
+
+unsigned dict_len(struct dict *dict)
+{
+    return dict->size;
+}
+
+// The i-th key in insertion order.
+const void *dict_key(struct dict *dict, unsigned i)
+{
+    assert(i < dict->size);
+    return dict->entries[i].key;
+}
+
+void *dict_value(struct dict *dict, unsigned i)
+{
+    assert(i < dict->size);
+    return dict->entries[i].value;
 }
 
 struct vector *dict_values(struct dict *dict)
 {
     struct vector *v = vec_new();
-    for (int i = 0; i < vec_len(dict->keys); i++) {
-        const void *key = vec_at(dict->keys, i);
-        void *value = map_get(dict->map, key);
-        vec_push_safe(v, value);
-    }
+    for (unsigned i = 0; i < dict->size; i++)
+        vec_push_safe(v, dict->entries[i].value);
     return v;
 }
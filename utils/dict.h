@@ -1,9 +1,22 @@
 #ifndef _DICT_H
 #define _DICT_H
 
+struct dict_entry {
+    const void *key;
+    void *value;
+    unsigned hash;
+};
+
+/**
+ * An insertion-ordered map: the entries are kept dense in
+ * insertion order, and an open-addressing index maps a key
+ * to its entry.
+ */
 struct dict {
-    struct map *map;
-    struct vector *keys;
+    struct dict_entry *entries;
+    unsigned size, alloc;
+    unsigned *index;                // entry + 1, 0 if empty
+    unsigned tablesize;
 };
 
 extern struct dict *dict_new(void);
@@ -14,6 +27,12 @@ extern void dict_put(struct dict *dict, const void *key, void *value);
 
 extern void *dict_get(struct dict *dict, const void *key);
 
+extern unsigned dict_len(struct dict *dict);
+
+extern const void *dict_key(struct dict *dict, unsigned i);
+
+extern void *dict_value(struct dict *dict, unsigned i);
+
 extern struct vector *dict_values(struct dict *dict);
 
 #endif
@@ -1,42 +1,82 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "utils.h"
 
-// a key-value implementation
-
-#define MAP_INIT_SIZE       64
-#define MAP_GROW_FACTOR     80
-#define MAP_RESIZE_BITS     2
+/* A key-value implementation.
+ *
+ * Open addressing with linear probing and Robin Hood
+ * insertion: an entry never sits further from its home
+ * slot than the entry it displaced, so a lookup stops as
+ * soon as it meets an entry closer to home than itself.
+ * Most keys are interned, so a slot is first tested by
+ * pointer. The hash of each key is kept in its slot, the
+ * keys are only compared when the hashes are equal, and
+ * the table is rehashed without hashing the keys again.
+ * All entries live in the table, nothing is allocated per
+ * entry. The table is kept at most half full, which keeps
+ * most keys in their home slot.
+ *
+ * Removing an entry shifts the following entries back
+ * one slot, so there are no tombstones.
+ *
+ * A map made by ptrmap_new() is keyed by identity: it
+ * hashes the pointer and never looks at the string.
+ */
+
+#define MAP_INIT_SIZE       16
+#define MAP_GROW_FACTOR     50
+
+// distance of slot 'i' from the home slot of 'hash'
+#define DIST(map, hash, i)  (((i) - (hash)) & ((map)->tablesize - 1))
 
 static void alloc_map(struct map *map, unsigned size)
 {
-    map->table = zmalloc(size * sizeof(struct map_entry *));
+    map->table = xcalloc(size, sizeof(struct map_entry));
     map->tablesize = size;
     map->grow_at = (unsigned)(size * MAP_GROW_FACTOR / 100);
-    map->shrink_at = map->grow_at / ((1 << MAP_RESIZE_BITS) + 1);
 }
 
-static unsigned bucket(struct map *map, const void *key)
+static unsigned map_hash(struct map *map, const void *key)
 {
-    return strhash(key) & (map->tablesize - 1);
+    unsigned hash = map->hashfn(key);
+    // 0 marks an empty slot
+    return hash ? hash : 1;
+}
+
+static void insert(struct map *map, struct map_entry entry)
+{
+    unsigned mask = map->tablesize - 1;
+    unsigned i = entry.hash & mask;
+    for (unsigned d = 0;; i = (i + 1) & mask, d++) {
+        struct map_entry *e = &map->table[i];
+        if (e->hash == 0) {
+            *e = entry;
+            break;
+        }
+        unsigned ed = DIST(map, e->hash, i);
+        if (ed < d) {
+            // take the slot from a richer entry
+            struct map_entry tmp = *e;
+            *e = entry;
+            entry = tmp;
+            d = ed;
+        }
+    }
+    map->size++;
 }
 
 static void rehash(struct map *map, unsigned newsize)
 {
     unsigned oldsize = map->tablesize;
-    struct map_entry **oldtable = map->table;
+    struct map_entry *oldtable = map->table;
 
     alloc_map(map, newsize);
-    for (int i = 0; i < oldsize; i++) {
-        struct map_entry *entry = oldtable[i];
-        while (entry) {
-            struct map_entry *next = entry->next;
-            unsigned b = bucket(map, entry->key);
-            entry->next = map->table[b];
-            map->table[b] = entry;
-            entry = next;
-        }
+    map->size = 0;
+    for (unsigned i = 0; i < oldsize; i++) {
+        if (oldtable[i].hash)
+            insert(map, oldtable[i]);
     }
     free(oldtable);
 }
@@ -46,86 +86,121 @@ static int cmp(const void *key1, const void *key2)
     return strcmp(key1, key2);
 }
 
-int nocmp(const void *key1, const void *key2)
+static unsigned keyhash(const void *key)
 {
-    return 1;
+    return strhash(key);
 }
 
-static int eqentry(struct map *map, struct map_entry *entry, const void *key)
+// Fibonacci hashing, the low bits of an address are zeros.
+static unsigned ptrhash(const void *key)
 {
-    return entry->key == key || !map->cmpfn(entry->key, key);
+    return (uint64_t)(uintptr_t) key * 0x9E3779B97F4A7C15ull >> 32;
 }
 
-static struct map_entry **find_entry(struct map *map, const void *key)
+int nocmp(const void *key1, const void *key2)
 {
-    struct map_entry **entry = &map->table[bucket(map, key)];
-    while (*entry && !eqentry(map, *entry, key))
-        entry = &(*entry)->next;
-    return entry;
+    return 1;
 }
 
-static void map_remove(struct map *map, const void *key)
+static struct map_entry *find_entry(struct map *map, const void *key,
+                                    unsigned hash)
 {
-    struct map_entry **entry = find_entry(map, key);
-    if (!*entry)
-        return;
-
-    struct map_entry *old = *entry;
-    *entry = old->next;
-    free(old);
-
-    map->size--;
-    if (map->size < map->shrink_at)
-        rehash(map, map->tablesize >> MAP_RESIZE_BITS);
+    unsigned mask = map->tablesize - 1;
+    unsigned i = hash & mask;
+    for (unsigned d = 0;; i = (i + 1) & mask, d++) {
+        struct map_entry *e = &map->table[i];
+        if (e->hash == 0 || DIST(map, e->hash, i) < d)
+            return NULL;
+        if (e->key == key || (e->hash == hash && !map->cmpfn(e->key, key)))
+            return e;
+    }
 }
 
-static void map_add(struct map *map, const void *key, void *value)
+static void remove_entry(struct map *map, struct map_entry *entry)
 {
-    unsigned b = bucket(map, key);
-    struct map_entry *entry = zmalloc(sizeof(struct map_entry));
-    entry->key = key;
-    entry->value = value;
-    entry->next = map->table[b];
-    map->table[b] = entry;
-    map->size++;
-    if (map->size > map->grow_at)
-        rehash(map, map->tablesize << MAP_RESIZE_BITS);
+    unsigned mask = map->tablesize - 1;
+    unsigned i = entry - map->table;
+    for (;;) {
+        unsigned j = (i + 1) & mask;
+        struct map_entry *e = &map->table[j];
+        if (e->hash == 0 || DIST(map, e->hash, j) == 0)
+            break;
+        map->table[i] = *e;
+        i = j;
+    }
+    map->table[i] = (struct map_entry){ 0 };
+    map->size--;
 }
 
 struct map *map_new(void)
 {
     struct map *map = zmalloc(sizeof(struct map));
     map->size = 0;
+    map->hashfn = keyhash;
     map->cmpfn = cmp;
     alloc_map(map, MAP_INIT_SIZE);
     return map;
 }
 
+struct map *ptrmap_new(void)
+{
+    struct map *map = map_new();
+    map->hashfn = ptrhash;
+    map->cmpfn = nocmp;
+    return map;
+}
+
 void map_free(struct map *map)
 {
     if (!map)
         return;
-    for (int i = 0; i < map->tablesize; i++) {
-        struct map_entry *entry = map->table[i];
-        while (entry) {
-            struct map_entry *next = entry->next;
-            free(entry);
-            entry = next;
-        }
-    }
     free(map->table);
     free(map);
 }
 
 void *map_get(struct map *map, const void *key)
 {
-    struct map_entry *entry = *find_entry(map, key);
+    struct map_entry *entry = find_entry(map, key, map_hash(map, key));
     return entry ? entry->value : NULL;
 }
 
+/**
+ * Update the value of 'key' in place, a NULL value removes
+ * the key. The table only grows, and only on insertion.
+ */
 void map_put(struct map *map, const void *key, void *value)
 {
-    map_remove(map, key);
-    if (value)
-        map_add(map, key, value);
+    unsigned hash = map_hash(map, key);
+    struct map_entry *entry = find_entry(map, key, hash);
+    if (entry) {
+        if (value)
+            entry->value = value;
+        else
+            remove_entry(map, entry);
+    } else if (value) {
+        if (map->size >= map->grow_at)
+            rehash(map, map->tablesize << 1);
+        insert(map, (struct map_entry){
+                .key = key,.value = value,.hash = hash});
+    }
+}
+
+struct vector *map_keys(struct map *map)
+{
+    struct vector *v = vec_new();
+    for (unsigned i = 0; i < map->tablesize; i++) {
+        if (map->table[i].hash)
+            vec_push(v, (void *)map->table[i].key);
+    }
+    return v;
+}
+
+struct vector *map_values(struct map *map)
+{
+    struct vector *v = vec_new();
+    for (unsigned i = 0; i < map->tablesize; i++) {
+        if (map->table[i].hash)
+            vec_push(v, map->table[i].value);
+    }
+    return v;
 }
@@ -4,24 +4,31 @@
 struct map_entry {
     const void *key;
     void *value;
-    struct map_entry *next;
+    unsigned hash;                // 0 if the slot is empty
 };
 
 struct map {
     unsigned size, tablesize;
-    unsigned grow_at, shrink_at;
-    struct map_entry **table;
+    unsigned grow_at;
+    struct map_entry *table;
+    unsigned (*hashfn) (const void *key);
     int (*cmpfn) (const void *key1, const void *key2);
 };
 
 extern struct map *map_new(void);
 
+extern struct map *ptrmap_new(void);
+
 extern void map_free(struct map *map);
 
 extern void *map_get(struct map *map, const void *key);
 
 extern void map_put(struct map *map, const void *key, void *value);
 
+extern struct vector *map_keys(struct map *map);
+
+extern struct vector *map_values(struct map *map);
+
 extern int nocmp(const void *key1, const void *key2);
 
 #endif
@@ -37,6 +37,12 @@ void strbuf_free(struct strbuf *s)
     free(s);
 }
 
+void strbuf_clear(struct strbuf *s)
+{
+    s->len = 0;
+    s->str[0] = '\0';
+}
+
 size_t strbuf_len(struct strbuf * s)
 {
     return s->len;
@@ -11,6 +11,8 @@ extern struct strbuf *strbuf_new(void);
 
 extern void strbuf_free(struct strbuf *s);
 
+extern void strbuf_clear(struct strbuf *s);
+
 extern size_t strbuf_len(struct strbuf *s);
 
 extern const char *strbuf_str(struct strbuf *s);
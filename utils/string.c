@@ -4,78 +4,155 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "utils.h"
 
-#define FNV32_BASIS ((unsigned) 0x811c9dc5)
-#define FNV32_PRIME ((unsigned) 0x01000193)
-
-struct str_table {
-    struct str_bucket {
-        char *str;
-        size_t len;
-        struct str_bucket *next;
-    } *buckets[1024];
+/* Interned strings
+ *
+ * Every string is stored once, in a block cut from a chunked
+ * arena that holds its hash, length and a slot for the user's
+ * data in front of the characters:
+ *
+ *   | hash | len | info | chars ... '\0' |
+ *                        ^ the interned pointer
+ *
+ * The table is open addressing with linear probing over
+ * pointers to the blocks, doubled when half full.
+ */
+#define STR_TABLE_SIZE     1024
+#define STR_CHUNK_SIZE     (64 * 1024)
+#define HASH_MULT          0x9E3779B97F4A7C15ull
+
+struct str_rec {
+    unsigned hash;
+    unsigned len;
+    void *info;
+    char str[FLEX_ARRAY];
 };
 
-// FNV-1a
+static THREAD_LOCAL struct str_table {
+    struct str_rec **slots;
+    unsigned size;
+    unsigned count;
+    char *avail;                // free space of current chunk
+    char *limit;
+} table;
+
+#define STR_REC(s)  ((struct str_rec *)((s) - offsetof(struct str_rec, str)))
+
+// Word at a time, reads exactly 'len' bytes.
+unsigned strhashn(const char *s, size_t len)
+{
+    uint64_t h = len * HASH_MULT;
+    uint64_t w;
+    for (; len >= sizeof w; s += sizeof w, len -= sizeof w) {
+        memcpy(&w, s, sizeof w);
+        h = ((h << 5 | h >> 59) ^ w) * HASH_MULT;
+    }
+    if (len) {
+        w = 0;
+        memcpy(&w, s, len);
+        h = ((h << 5 | h >> 59) ^ w) * HASH_MULT;
+    }
+    return h ^ h >> 32;
+}
+
 unsigned strhash(const char *s)
 {
-    unsigned hash = FNV32_BASIS;
-    for (; *s; s++) {
-        hash ^= *s;
-        hash *= FNV32_PRIME;
+    return strhashn(s, strlen(s));
+}
+
+static void *str_alloc(size_t size)
+{
+    size = ROUNDUP(size, ALIGN_SIZE);
+    if (size > table.limit - table.avail) {
+        if (size > STR_CHUNK_SIZE / 4)
+            return xmalloc(size);
+        table.avail = xmalloc(STR_CHUNK_SIZE);
+        table.limit = table.avail + STR_CHUNK_SIZE;
     }
-    return hash;
+    void *p = table.avail;
+    table.avail += size;
+    return p;
 }
 
-char *strn(const char *src, size_t len)
+static void str_grow(void)
 {
-    static struct str_table *table;
-    struct str_bucket *ps;
-    register unsigned int hash;
-    const char *end = src + len;
+    unsigned oldsize = table.size;
+    struct str_rec **oldslots = table.slots;
+
+    table.size = oldsize ? oldsize << 1 : STR_TABLE_SIZE;
+    table.slots = xcalloc(table.size, sizeof(struct str_rec *));
+    unsigned mask = table.size - 1;
+    for (unsigned i = 0; i < oldsize; i++) {
+        struct str_rec *rec = oldslots[i];
+        if (!rec)
+            continue;
+        unsigned j = rec->hash & mask;
+        while (table.slots[j])
+            j = (j + 1) & mask;
+        table.slots[j] = rec;
+    }
+    free(oldslots);
+}
 
+char *strn(const char *src, size_t len)
+{
     if (src == NULL || len <= 0)
         return NULL;
 
-    if (!table)
-        table = zmalloc(sizeof(struct str_table));
-
-    hash = strhash(src) & (ARRAY_SIZE(table->buckets) - 1);
-    for (ps = table->buckets[hash]; ps; ps = ps->next) {
-        if (ps->len == len) {
-            const char *s1 = src;
-            char *s2 = ps->str;
-            do {
-                if (s1 == end)
-                    return ps->str;
-            } while (*s1++ == *s2++);
-        }
+    if (table.count >= table.size / 2)
+        str_grow();
+
+    unsigned hash = strhashn(src, len);
+    unsigned mask = table.size - 1;
+    unsigned i = hash & mask;
+    for (struct str_rec *rec; (rec = table.slots[i]); i = (i + 1) & mask) {
+        if (rec->hash == hash && rec->len == len &&
+            !memcmp(rec->str, src, len))
+            return rec->str;
     }
 
     // alloc
-    {
-        char *dst = zmalloc(len + 1);
-        ps = zmalloc(sizeof(struct str_bucket));
-        ps->len = len;
-        for (ps->str = dst; src < end;)
-            *dst++ = *src++;
-        *dst++ = '\0';
-        ps->next = table->buckets[hash];
-        table->buckets[hash] = ps;
-
-        return ps->str;
-    }
+    struct str_rec *rec = str_alloc(offsetof(struct str_rec, str) + len + 1);
+    rec->hash = hash;
+    rec->len = len;
+    rec->info = NULL;
+    memcpy(rec->str, src, len);
+    rec->str[len] = '\0';
+    table.slots[i] = rec;
+    table.count++;
+    return rec->str;
 }
 
 char *strs(const char *str)
 {
-    const char *s = str;
     if (!str)
         return NULL;
-    while (*s)
-        s++;
-    return strn(str, s - str);
+    return strn(str, strlen(str));
+}
+
+// The hash and length of an interned string, without rescanning it.
+unsigned strs_hash(const char *s)
+{
+    return STR_REC(s)->hash;
+}
+
+size_t strs_len(const char *s)
+{
+    return STR_REC(s)->len;
+}
+
+// The data attached to an interned string, NULL at first.
+void *strs_info(const char *s)
+{
+    return STR_REC(s)->info;
+}
+
+void strs_set_info(const char *s, void *info)
+{
+    STR_REC(s)->info = info;
 }
 
 char *strd(long long n)
@@ -112,25 +189,23 @@ char *stru(unsigned long long n)
     return strn(s, str + sizeof(str) - s);
 }
 
+/* Formatted strings are never freed, they are cut from the
+ * chunks of the intern table.
+ */
 static char *vformat(const char *fmt, va_list ap)
 {
-    size_t size = 128;
-    void *buffer = NULL;
+    char buf[128];
     va_list aq;
-    for (;;) {
-        size_t avail = size;
-        buffer = zmalloc(avail);
-        va_copy(aq, ap);
-        int total = vsnprintf(buffer, avail, fmt, aq);
-        va_end(aq);
-        if (avail <= total) {
-            size = total + 8;
-            continue;
-        }
-        break;
-    }
+    va_copy(aq, ap);
+    int total = vsnprintf(buf, sizeof buf, fmt, aq);
+    va_end(aq);
 
-    return buffer;
+    char *str = str_alloc(total + 1);
+    if (total < sizeof buf)
+        memcpy(str, buf, total + 1);
+    else
+        vsnprintf(str, total + 1, fmt, ap);
+    return str;
 }
 
 char *format(const char *fmt, ...)
@@ -9,6 +9,20 @@
 
 #define FLEX_ARRAY                /* flexible array */
 
+/**
+ * State that belongs to one translation unit is thread local,
+ * so several units may be compiled on threads of one process.
+ * A thread compiles one unit at a time. Compilers without
+ * thread-local storage get plain statics.
+ */
+#if __STDC_VERSION__ >= 201112L
+#define THREAD_LOCAL    _Thread_local
+#elif defined(__GNUC__)
+#define THREAD_LOCAL    __thread
+#else
+#define THREAD_LOCAL
+#endif
+
 #define ALIGN_SIZE          (sizeof (long long))
 #define ROUNDUP(x, align)   (((x)+((align)-1))&(~((align)-1)))
 
@@ -29,8 +43,13 @@ extern int log2i(size_t i);
 
 // string.c
 extern unsigned strhash(const char *s);
+extern unsigned strhashn(const char *s, size_t len);
 extern char *strs(const char *str);
 extern char *strn(const char *src, size_t len);
+extern unsigned strs_hash(const char *s);
+extern size_t strs_len(const char *s);
+extern void *strs_info(const char *s);
+extern void strs_set_info(const char *s, void *info);
 extern char *strd(long long n);
 extern char *stru(unsigned long long n);
 extern char *format(const char *fmt, ...);
@@ -4,24 +4,54 @@
 #include <stdbool.h>
 #include "utils.h"
 
-#define VEC_INIT_SIZE   16
+#define VEC_MIN_SIZE    16
+
+// base of the storage
+#define VEC_BASE(v)     ((v)->mem - (v)->front)
+
+/**
+ * Move the elements to a heap block with 'front' free
+ * slots before them and 'back' free slots after them.
+ */
+static void vec_resize(struct vector *v, size_t front, size_t back)
+{
+    size_t size = MAX(VEC_MIN_SIZE, front + v->len + back);
+    void **base = VEC_BASE(v);
+    void **mem;
+    if (base != v->inline_mem && front == v->front) {
+        mem = xrealloc(base, size * sizeof(void *));
+    } else {
+        mem = xmalloc(size * sizeof(void *));
+        memcpy(mem + front, v->mem, v->len * sizeof(void *));
+        if (base != v->inline_mem)
+            free(base);
+    }
+    v->front = front;
+    v->mem = mem + front;
+    v->alloc = size - front;
+}
 
+// Make room at the back.
 static void vec_grow(struct vector *v)
 {
-    void *oldmem = v->mem;
-    v->alloc <<= 1;
-    v->mem = xmalloc(v->alloc * sizeof(void *));
-    memcpy(v->mem, oldmem, v->len * sizeof(void *));
-    if (v->len > 0)
-        free(oldmem);
+    if (v->front >= v->len) {
+        // mostly popped from the front, slide down
+        memmove(VEC_BASE(v), v->mem, v->len * sizeof(void *));
+        v->mem -= v->front;
+        v->alloc += v->front;
+        v->front = 0;
+    } else {
+        vec_resize(v, v->front, MAX(v->len, VEC_INLINE_SIZE));
+    }
 }
 
 struct vector *vec_new(void)
 {
     struct vector *v = xmalloc(sizeof(struct vector));
+    v->mem = v->inline_mem;
     v->len = 0;
-    v->alloc = VEC_INIT_SIZE;
-    vec_grow(v);
+    v->alloc = VEC_INLINE_SIZE;
+    v->front = 0;
     return v;
 }
 
@@ -34,7 +64,8 @@ struct vector *vec_new1(void *val)
 
 void vec_free(struct vector *v)
 {
-    free(v->mem);
+    if (VEC_BASE(v) != v->inline_mem)
+        free(VEC_BASE(v));
     free(v);
 }
 
@@ -108,10 +139,23 @@ void vec_push_safe(struct vector *v, void *val)
 void vec_push_front(struct vector *v, void *val)
 {
     assert(val);
+    if (v->front == 0)
+        vec_resize(v, MAX(v->len, VEC_INLINE_SIZE), v->alloc - v->len);
+    v->mem--;
+    v->front--;
+    v->alloc++;
+    v->mem[0] = val;
+    v->len++;
+}
+
+void vec_insert(struct vector *v, int index, void *val)
+{
+    assert(val && index >= 0 && index <= v->len);
     if (v->len == v->alloc)
         vec_grow(v);
-    memmove(v->mem + 1, v->mem, v->len * sizeof(void *));
-    v->mem[0] = val;
+    memmove(v->mem + index + 1, v->mem + index,
+            (v->len - index) * sizeof(void *));
+    v->mem[index] = val;
     v->len++;
 }
 
@@ -129,13 +173,18 @@ void *vec_pop_front(struct vector *v)
     if (v->len == 0)
         return NULL;
     void *r = v->mem[0];
+    v->mem++;
+    v->front++;
+    v->alloc--;
     v->len--;
-    memmove(v->mem, v->mem + 1, v->len * sizeof(void *));
     return r;
 }
 
 void vec_clear(struct vector *v)
 {
+    v->mem -= v->front;
+    v->alloc += v->front;
+    v->front = 0;
     v->len = 0;
 }
 
@@ -1,10 +1,20 @@
 #ifndef _VECTOR_H
 #define _VECTOR_H
 
+#define VEC_INLINE_SIZE  4
+
+/**
+ * A vector starts in its inline slots and moves to the
+ * heap when they are full. Elements are contiguous from
+ * 'mem', with 'front' free slots before it, so both ends
+ * push and pop in amortized O(1).
+ */
 struct vector {
     void **mem;
     size_t len;
-    size_t alloc;
+    size_t alloc;                // slots from 'mem' on
+    size_t front;                // free slots before 'mem'
+    void *inline_mem[VEC_INLINE_SIZE];
 };
 
 extern struct vector *vec_new(void);
@@ -29,6 +39,8 @@ extern void vec_push_safe(struct vector *v, void *val);
 
 extern void vec_push_front(struct vector *v, void *val);
 
+extern void vec_insert(struct vector *v, int index, void *val);
+
 extern void *vec_pop(struct vector *v);
 
 extern void *vec_pop_front(struct vector *v);